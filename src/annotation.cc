@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <htslib/sam.h>
+
+#include "annotation.h"
+
+annotation::annotation(const string &file)
+{
+	ifstream fin(file.c_str());
+	if(fin.fail()) printf("fail to open annotation %s\n", file.c_str());
+	if(fin.fail()) exit(0);
+
+	bool bed = (file.size() >= 4 && file.substr(file.size() - 4) == ".bed");
+
+	vector< vector< pair<int32_t, int32_t> > > exons;
+	string line;
+	while(getline(fin, line))
+	{
+		if(line.size() == 0 || line[0] == '#') continue;
+		if(bed == true)
+		{
+			add_bed(line, exons);
+			continue;
+		}
+
+		stringstream liness(line);
+		string chr, source, type, startss, endss, score, strand, frame, info;
+		getline(liness, chr, '\t');
+		getline(liness, source, '\t');
+		getline(liness, type, '\t');
+		if(type != "exon") continue;
+
+		getline(liness, startss, '\t');
+		getline(liness, endss, '\t');
+		getline(liness, score, '\t');
+		getline(liness, strand, '\t');
+		getline(liness, frame, '\t');
+		getline(liness, info, '\t');
+
+		string tid = gtf_attribute(info, "transcript_id");
+		map<string, int>::iterator it = index.find(tid);
+		int t = (it == index.end()) ? names.size() : it->second;
+		if(it == index.end())
+		{
+			index.insert(make_pair(tid, t));
+			names.push_back(tid);
+			genes.push_back(gtf_attribute(info, "gene_id"));
+			chrs.push_back(chr);
+			strands.push_back(strand.size() >= 1 ? strand[0] : '.');
+			exons.resize(t + 1);
+		}
+		exons[t].push_back(make_pair(atoi(startss.c_str()) - 1, atoi(endss.c_str())));	// 0-based, half-open
+	}
+
+	offset.push_back(0);
+	for(int t = 0; t < exons.size(); t++)
+	{
+		vector< pair<int32_t, int32_t> > &v = exons[t];
+		sort(v.begin(), v.end());
+		v.erase(unique(v.begin(), v.end()), v.end());
+		for(int k = 0; k < v.size(); k++)
+		{
+			starts.push_back(v[k].first);
+			ends.push_back(v[k].second);
+			reach.push_back(k == 0 ? v[k].second : max(reach.back(), v[k].second));
+		}
+		offset.push_back(starts.size());
+	}
+}
+
+/*
+ one transcript per BED line, 0-based, with its blocks (BED12) or the
+ whole interval as exons; the name serves as both transcript and gene
+*/
+int annotation::add_bed(const string &line, vector< vector< pair<int32_t, int32_t> > > &exons)
+{
+	if(line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0) return 0;
+
+	vector<string> v;
+	stringstream liness(line);
+	string s;
+	while(getline(liness, s, '\t')) v.push_back(s);
+	if(v.size() < 3) return 0;
+
+	int32_t start = atoi(v[1].c_str());
+	int32_t end = atoi(v[2].c_str());
+	string name = (v.size() >= 4) ? v[3] : v[0] + ":" + v[1] + "-" + v[2];
+
+	int t = names.size();
+	index.insert(make_pair(name, t));
+	names.push_back(name);
+	genes.push_back(name);
+	chrs.push_back(v[0]);
+	strands.push_back(v.size() >= 6 && v[5].size() >= 1 ? v[5][0] : '.');
+	exons.resize(t + 1);
+
+	if(v.size() < 12)
+	{
+		exons[t].push_back(make_pair(start, end));
+		return 0;
+	}
+
+	stringstream sizes(v[10]), offsets(v[11]);
+	string a, b;
+	while(getline(sizes, a, ',') && getline(offsets, b, ','))
+	{
+		int32_t p = start + atoi(b.c_str());
+		exons[t].push_back(make_pair(p, p + atoi(a.c_str())));
+	}
+	return 0;
+}
+
+int annotation::find(const string &tid) const
+{
+	map<string, int>::const_iterator it = index.find(tid);
+	if(it == index.end()) return -1;
+	return it->second;
+}
+
+// first exon of transcript t reaching p or beyond, offset[t + 1] if none
+int annotation::first_exon(int t, int32_t p) const
+{
+	return lower_bound(reach.begin() + offset[t], reach.begin() + offset[t + 1], p) - reach.begin();
+}
+
+/*
+ cigar (M for exonic, N for intronic parts) of the fragment [start, end)
+ following the exons of transcript t; challenge tells whether an intron
+ lies within the gap [gap_start, gap_end) between the two mates
+*/
+int annotation::bridge(int t, int32_t start, int32_t end, int32_t gap_start, int32_t gap_end, vector<uint32_t> &cigar, bool &challenge) const
+{
+	cigar.clear();
+	challenge = false;
+	if(t < 0) return 0;
+
+	int32_t p1 = start, p2 = start;
+	for(int k = first_exon(t, start); k < offset[t + 1] && p2 < end; k++)
+	{
+		if(ends[k] < start) continue;			// inside an earlier, longer exon
+		if(starts[k] >= end) break;				// the fragment ends in an intron
+
+		p1 = max(p2, starts[k]);
+		if(p1 > p2)
+		{
+			cigar.push_back(bam_cigar_gen(p1 - p2, BAM_CREF_SKIP));
+			if(p2 > gap_start && p1 <= gap_end) challenge = true;
+		}
+
+		p2 = min(end, ends[k]);
+		if(p2 > p1) cigar.push_back(bam_cigar_gen(p2 - p1, BAM_CMATCH));
+	}
+	return 0;
+}
+
+string gtf_attribute(const string &info, const string &key)
+{
+	stringstream ss(info);
+	string k, v;
+	while(ss >> k)
+	{
+		if(!(ss >> v)) break;
+		if(k != key) continue;
+		if(v.size() >= 1 && v[v.size() - 1] == ';') v.erase(v.size() - 1);
+		if(v.size() >= 2 && v[0] == '"' && v[v.size() - 1] == '"') v = v.substr(1, v.size() - 2);
+		return v;
+	}
+	return "";
+}
@@ -0,0 +1,45 @@
+#ifndef __ANNOTATION_H__
+#define __ANNOTATION_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ exons of the transcripts of a GTF (or .bed) file in flat arrays: exons
+ of transcript t are [offset[t], offset[t + 1]), sorted, 0-based, half-open
+*/
+class annotation
+{
+public:
+	annotation(const string &file);
+
+public:
+	vector<string> names;				// transcript ids
+	vector<string> genes;				// gene id of each transcript
+	vector<string> chrs;				// chromosome of each transcript
+	vector<char> strands;				// strand of each transcript
+	vector<int32_t> offset;				// first exon of each transcript, plus the end
+	vector<int32_t> starts;				// exon starts
+	vector<int32_t> ends;				// exon ends
+	vector<int32_t> reach;				// max of ends from the first exon of the transcript
+
+public:
+	int find(const string &tid) const;	// index of a transcript, -1 if unknown
+	int first_exon(int t, int32_t p) const;
+	int bridge(int t, int32_t start, int32_t end, int32_t gap_start, int32_t gap_end, vector<uint32_t> &cigar, bool &challenge) const;
+
+private:
+	map<string, int> index;
+
+private:
+	int add_bed(const string &line, vector< vector< pair<int32_t, int32_t> > > &exons);
+};
+
+// value of attribute key in the 9th column of a GTF line
+string gtf_attribute(const string &info, const string &key);
+
+#endif
@@ -1,168 +1,351 @@
 #include <cstdio>
 #include <cassert>
+#include <cstring>
+#include <thread>
 #include <sstream>
 
 #include "config.h"
 #include "bamkit.h"
 
-bamkit::bamkit(const string &bamfile)
+eval_result::eval_result()
 {
-    sfn = sam_open(bamfile.c_str(), "r");
+	totalGT = 0;
+	totalAligner = 0;
+	common = 0;
+	wrong = 0;
+	sensitivity = 0;
+	precision = 0;
+}
+
+bamkit::bamkit(const string &bamfile, const options &o)
+	: opt(o), file(bamfile)
+{
+	owner = true;
+	keep_eval = false;
+    sfn = open_input(opt, bamfile);
+	if(sfn == NULL) printf("fail to open %s\n", bamfile.c_str());
+	if(sfn == NULL) exit(0);
     hdr = sam_hdr_read(sfn);
     b1t = bam_init1();
-	qlen = 0;
-	qcnt = 0;
+}
+
+bamkit::bamkit(samFile *f, bam_hdr_t *h, const options &o)
+	: opt(o)
+{
+	owner = false;
+	keep_eval = false;
+	sfn = f;
+	hdr = h;
+    b1t = bam_init1();
 }
 
 bamkit::~bamkit()
 {
     bam_destroy1(b1t);
+	if(owner == false) return;
     bam_hdr_destroy(hdr);
     sam_close(sfn);
 }
 
 int bamkit::solve_count()
 {
-	int maxisize = 500;
-	ivec.clear();
-	ivec.assign(maxisize, 0);
-    while(sam_read1(sfn, hdr, b1t) >= 0)
-	{
-		bam1_core_t &p = b1t->core;
-
-		if((p.flag & 0x4) >= 1) continue;										// read is not mapped
-		if((p.flag & 0x100) >= 1 && use_second_alignment == false) continue;	// secondary alignment
-		if(p.n_cigar > MAX_NUM_CIGAR) continue;									// ignore hits with more than 7 cigar types
-		if(p.qual < min_mapping_quality) continue;								// ignore hits with small quality
-		if(p.n_cigar < 1) continue;												// should never happen
+	count_collector cc(opt, false);
+	if(opt.estimate == false || estimate(cc) != 0) scan_scaled(cc, "count");
+	cc.print();
+	return 0;
+}
 
-		hit ht(b1t, 1);
+int bamkit::solve_strand()
+{
+	if(opt.annotation == "")
+	{
+		strand_collector sc(opt, 100000);
+		scan(sc, "strand");
+		sc.print();
+		return 0;
+	}
 
-		qlen += ht.qlen;
-		qcnt += 1;
+	// every read overlapping genes of one strand is a sample, so it stops early
+	strand_collector sc(opt, 1000000, make_shared<gene_index>(annotation(opt.annotation), hdr));
+	scan(sc, "strand\t" + identity_key(opt.annotation));
+	sc.print();
+	return 0;
+}
 
-		if(ht.isize <= 0 || ht.isize >= maxisize) continue;
+int bamkit::solve_fragment()
+{
+	count_collector cc(opt, true);
+	if(opt.estimate == false || estimate(cc) != 0) scan_scaled(cc, "fragment");
+	cc.print();
+	return 0;
+}
 
-		ivec[ht.isize]++;
-	}
+int bamkit::solve_junction()
+{
+	junction_collector jc(opt, hdr);
+	engine eg;
+	eg.push(&jc);
+	run(eg);
+	jc.print();
+	return 0;
+}
 
-	int icnt = 0;
-	double iave = 0;
-	double idev = 0;
-	for(int i = 1; i < ivec.size(); i++)
-	{
-		icnt += ivec[i];
-		iave += ivec[i] * i;
-	}
-	iave = iave / icnt;
+int bamkit::solve_stats()
+{
+	shared_ptr<const gene_index> genes;
+	if(opt.annotation != "") genes = make_shared<gene_index>(annotation(opt.annotation), hdr);
+
+	count_collector cc(opt, false);
+	strand_collector sc(opt, genes == NULL ? 100000 : 1000000, genes);
+	mate_collector mc(opt);
+	basestats_collector bc(opt, false);
+	edit_collector ec(opt, hdr, false);
+	genecount_collector *gc = NULL;
+	if(genes != NULL) gc = new genecount_collector(opt, genes, false);
+	engine eg;
+	eg.push(&cc);
+	eg.push(&sc);
+	eg.push(&bc);
+	eg.push(&ec);
+	if(gc != NULL) eg.push(gc);
+	if(coordinate_sorted(hdr) == true) eg.push(&mc);
+	run(eg);
+	scale_sample(cc);
+	cc.print();
+	sc.print();
+	bc.print();
+	ec.print();
+	if(gc != NULL) gc->print();
+	if(gc != NULL) delete gc;
+	if(coordinate_sorted(hdr) == true) mc.print();
+	return 0;
+}
 
-	for(int i = 1; i < ivec.size(); i++)
-	{
-		idev += (i - iave) * (i - iave) * ivec[i];
-	}
-	idev = sqrt(idev / icnt);
+int bamkit::solve_pairs()
+{
+	if(coordinate_sorted(hdr) == false && opt.verbose >= 1) printf("warning: %s is not sorted by coordinate, waiting mates are not bounded\n", file.c_str());
 
-	printf("aligned reads = %d aligned base pair = %.0lf average read length = %.2lf insert size = %.2lf +- %.2lf\n", qcnt, qlen, qlen / qcnt, iave, idev);
+	mate_collector mc(opt);
+	engine eg;
+	eg.push(&mc);
+	run(eg);
+	mc.print();
+	return 0;
+}
 
+int bamkit::solve_dupstat()
+{
+	dup_collector dc(opt);
+	engine eg;
+	eg.push(&dc);
+	run(eg);
+	dc.finish();
+	dc.print();
 	return 0;
 }
 
-int bamkit::solve_strand()
+int bamkit::solve_basestats()
 {
-	int first = 0;
-	int second = 0;
-	int cnt = 0;
-	int n = 100000;
+	basestats_collector bc(opt, true);
+	engine eg;
+	eg.push(&bc);
+	run(eg);
+	bc.print();
+	return 0;
+}
 
-	library_type = FR_FIRST;
-    while(sam_read1(sfn, hdr, b1t) >= 0)
-	{
-		bam1_core_t &p = b1t->core;
+int bamkit::solve_edits()
+{
+	edit_collector ec(opt, hdr, true);
+	engine eg;
+	eg.push(&ec);
+	run(eg);
+	ec.print();
+	return 0;
+}
 
-		if((p.flag & 0x4) >= 1) continue;			// read is not mapped
-		if((p.flag & 0x8) >= 1) continue;			// mate is note mapped
-		if((p.flag & 0x100) >= 1) continue;			// secondary alignment
-		if(p.n_cigar > MAX_NUM_CIGAR) continue;
+int bamkit::solve_genecount(const string &gtfFile)
+{
+	annotation gtf(gtfFile);
+	genecount_collector gc(opt, make_shared<gene_index>(gtf, hdr), true);
+	engine eg;
+	eg.push(&gc);
+	run(eg);
+	gc.print();
+	return 0;
+}
 
-		hit ht(b1t, 6);
-        //cout << ht.hi << endl;
-		if(ht.xs == '.') continue;
+int bamkit::scan(collector &c, const string &command)
+{
+	result_cache rc(opt, file, command);
+	bool bgzf = (hts_get_format(sfn)->format == bam);
 
-		if(ht.strand == '+' && ht.xs == '+') first++;
-		if(ht.strand == '-' && ht.xs == '-') first++;
-		if(ht.strand == '+' && ht.xs == '-') second++;
-		if(ht.strand == '-' && ht.xs == '+') second++;
-		
-		//printf("xs = %c, strand = %c\n", ht.xs, ht.strand);
+	int64_t voffset = -1;
+	int r = (file == "") ? 0 : rc.lookup(c, voffset);
+	if(r == 1 || (r == 2 && c.done() == true))
+	{
+		if(opt.verbose >= 2) printf("%s of %s is read from cache\n", command.c_str(), file.c_str());
+		return 0;
+	}
 
-		cnt++;
-		if(cnt >= n) break;
+	if(r == 2)
+	{
+		int64_t f = (bgzf == true) ? bgzf_seek(sfn->fp.bgzf, voffset, SEEK_SET) : -1;
+		if(f < 0) printf("fail to resume %s from cache\n", file.c_str());
+		if(f < 0) exit(0);
+		if(opt.verbose >= 2) printf("%s of %s is resumed from cache\n", command.c_str(), file.c_str());
 	}
 
-	string type = "unstranded";
-	if(cnt >= 0.8 * n && first >= 0.8 * cnt) type = "first";
-	if(cnt >= 0.8 * n && second >= 0.8 * cnt) type = "second";
+	engine eg;
+	eg.push(&c);
+	run(eg);
 
-	printf("samples = %d, first = %d, second = %d, library = %s\n", cnt, first, second, type.c_str());
+	// a sharded scan leaves sfn behind, so its result can not be resumed
+	if(file != "") rc.store(c, (bgzf == true && eg.sharded == false) ? bgzf_tell(sfn->fp.bgzf) : -1);
 	return 0;
 }
 
-int bamkit::solve_fragment()
+// the counts of a full scan, scaled up from the sampled read names of --fraction
+int bamkit::scan_scaled(count_collector &cc, const string &command)
 {
-	int maxisize = 500;
-	ivec.clear();
-	ivec.assign(maxisize, 0);
-    while(sam_read1(sfn, hdr, b1t) >= 0)
-	{
-		bam1_core_t &p = b1t->core;
+	if(opt.estimate == true) printf("--estimate does not apply to %s (not BAM, or too small), scanning it instead\n", file.c_str());
+	scan(cc, command);
+	scale_sample(cc);
+	return 0;
+}
 
-		if((p.flag & 0x4) >= 1) continue;										// read is not mapped
-		if((p.flag & 0x100) >= 1 && use_second_alignment == false) continue;	// secondary alignment
-		if(p.n_cigar > MAX_NUM_CIGAR) continue;									// ignore hits with more than 7 cigar types
-		if(p.qual < min_mapping_quality) continue;								// ignore hits with small quality
-		if(p.n_cigar != 1) continue;
+int bamkit::scale_sample(count_collector &cc)
+{
+	if(opt.fraction >= 1.0) return 0;
+	cc.scale(1.0 / opt.fraction);
+	printf("counts are scaled up from the reads of %.2lf%% of names (--fraction), other numbers are of the sample\n", 100.0 * opt.fraction);
+	return 0;
+}
 
-		hit ht(b1t, 1);
+/*
+ fills cc from --fraction of the compressed bytes, in shards of
+ ESTIMATE_SPAN bytes at random offsets of equal strata, scaled to the
+ file; the 95% intervals of the totals are those of the ratio estimator
+ (reads per byte) over the shards. -1 if the input can not be sampled
+*/
+int bamkit::estimate(count_collector &cc)
+{
+	if(bgzf_shards::applicable(sfn, file) == false) return -1;
 
-		qlen += ht.qlen;
-		qcnt += 1;
+	bgzf_shards sh(file, hdr);
+	int64_t first = bgzf_tell(sfn->fp.bgzf);
+	int64_t total = sh.size - (first >> 16);
+	int64_t n = max((int64_t)ESTIMATE_MIN_SHARDS, (int64_t)(opt.fraction * total / ESTIMATE_SPAN));
+	if(n * ESTIMATE_SPAN >= total) return -1;
 
-		if(ht.isize <= 0 || ht.isize >= maxisize) continue;
+	sh.sample(first, n, ESTIMATE_SPAN, ESTIMATE_SEED);
+	int m = sh.starts.size();
+	if(m < 2) return -1;
 
-		ivec[ht.isize]++;
-	}
+	vector<collector*> units(m);
+	for(int k = 0; k < m; k++) units[k] = cc.spawn();
 
-	int icnt = 0;
-	double iave = 0;
-	double idev = 0;
-	for(int i = 1; i < ivec.size(); i++)
+	progress_meter *meter = open_progress();
+	int f = sh.run(max(1, opt.threads), [&units](int w, int k, bam1_t *b)
 	{
-		icnt += ivec[i];
-		iave += ivec[i] * i;
-	}
-	iave = iave / icnt;
+		units[k]->add(b);
+		return true;
+	}, meter);
+	if(meter != NULL) delete meter;
+	if(f < 0) printf("fail to read %s\n", file.c_str());
+	if(f < 0) exit(0);
 
-	for(int i = 1; i < ivec.size(); i++)
+	vector<double> reads(m), bases(m), bytes(sh.bytes.begin(), sh.bytes.end());
+	for(int k = 0; k < m; k++)
 	{
-		idev += (i - iave) * (i - iave) * ivec[i];
+		const count_collector &x = dynamic_cast<const count_collector&>(*units[k]);
+		reads[k] = x.qcnt;
+		bases[k] = x.qlen;
+		cc.merge(x);
+		cc.probe.merge(x.probe);
+		delete units[k];
 	}
-	idev = sqrt(idev / icnt);
 
-	printf("aligned reads = %d aligned base pair = %.0lf average read length = %.2lf insert size = %.2lf +- %.2lf\n", qcnt, qlen, qlen / qcnt, iave, idev);
+	double r1, h1, r2, h2;
+	ratio_interval(reads, bytes, total, r1, h1);
+	ratio_interval(bases, bytes, total, r2, h2);
+
+	double sampled = 0;
+	for(int k = 0; k < m; k++) sampled += bytes[k];
+	cc.scale(total / sampled);
 
+	printf("estimate from %d shards, %.0lf of %ld bytes (%.2lf%%): aligned reads = %.0lf +- %.0lf aligned base pair = %.0lf +- %.0lf (95%%)\n",
+			m, sampled, total, 100.0 * sampled / total, r1, h1, r2, h2);
 	return 0;
 }
 
+/*
+ total of x over a file of total bytes, from units of b bytes each,
+ by the ratio sum(x) / sum(b), with the half width of its 95% interval
+*/
+int ratio_interval(const vector<double> &x, const vector<double> &b, double total, double &estimate, double &half)
+{
+	int n = x.size();
+	double sx = 0, sb = 0;
+	for(int i = 0; i < n; i++) sx += x[i];
+	for(int i = 0; i < n; i++) sb += b[i];
+
+	estimate = 0;
+	half = 0;
+	if(n < 2 || sb <= 0) return 0;
+
+	double r = sx / sb;
+	double s2 = 0;
+	for(int i = 0; i < n; i++) s2 += (x[i] - r * b[i]) * (x[i] - r * b[i]);
+	s2 = s2 / (n - 1);
+
+	double f = min(1.0, sb / total);
+	double mb = sb / n;
+	double se = sqrt((1 - f) * s2 / n) / mb;
+
+	estimate = r * total;
+	half = 1.96 * se * total;
+	return 0;
+}
+
+int bamkit::run(engine &eg)
+{
+	eg.report_records = opt.report_records;
+	eg.report_seconds = opt.report_seconds;
+	eg.timing = opt.sample_timing;
+	eg.meter = open_progress();
+	eg.fraction = opt.fraction;
+
+	// partial reports follow the order of the file, so they need a single pass
+	bool reporting = (opt.report_records > 0 || opt.report_seconds > 0);
+	if(reporting == true || eg.run_shards(file, sfn, hdr, opt.threads) != 0) eg.run(sfn, hdr);
+
+	if(eg.meter != NULL) delete eg.meter;
+	eg.meter = NULL;
+	return 0;
+}
+
+// a meter of the scan of this->file by --progress, NULL if not wanted
+progress_meter *bamkit::open_progress() const
+{
+	if(opt.progress == "none") return NULL;
+	return new progress_meter(this->file, opt.progress == "json");
+}
+
 int bamkit::ts2XS(const string &file)
 {
-	samFile *fout = sam_open(file.c_str(), "w");
+	samFile *fout = open_output(opt, file);
 
 	int f = sam_hdr_write(fout, hdr);
 	if(f < 0) printf("fail to write header to %s\n", file.c_str());
 	if(f < 0) exit(0);
 
+	progress_meter *meter = open_progress();
+	int64_t n = 0;
+
     while(sam_read1(sfn, hdr, b1t) >= 0)
 	{
+		if(meter != NULL && ++n % PROGRESS_PERIOD == 0) meter->update(sfn, PROGRESS_PERIOD);
 		uint8_t *p = bam_aux_get(b1t, "ts");
 
 		if((p) && (*p) == 'A')
@@ -185,13 +368,15 @@ int bamkit::ts2XS(const string &file)
 	}
 
 	sam_close(fout);
+	if(meter != NULL) meter->update(sfn, n % PROGRESS_PERIOD);
+	if(meter != NULL) delete meter;
 	return 0;
 }
 
 int bamkit::name2to1(const string &file)
 {
-	BGZF *fout = bgzf_open(file.c_str(), "w");
-	int f = bam_hdr_write(fout, hdr);
+	samFile *fout = open_output(opt, file);
+	int f = sam_hdr_write(fout, hdr);
 	if(f < 0) printf("fail to write header to %s\n", file.c_str());
 	if(f < 0) exit(0);
 
@@ -202,49 +387,97 @@ int bamkit::name2to1(const string &file)
 		assert(l >= 2);
 		assert(qname[l - 2] == '.');
 		if(qname[l - 1] == '2') qname[l - 1] = '1';
-		f = bam_write1(fout, b1t);
+		f = sam_write1(fout, hdr, b1t);
 		if(f < 0) printf("fail write alignment to %s\n", file.c_str());
 		if(f < 0) exit(0);
 	}
 
-	bgzf_close(fout);
+	sam_close(fout);
 	return 0;
 }
 
 int bamkit::alignPairEval(const string &groundtruth)
 {
-    bamkit gt(groundtruth);
+    bamkit gt(groundtruth, opt);
+
+    // both files are grouped into the same buckets by query name when they do not fit in memory
+    int n = max(collator::buckets_for(opt, file), collator::buckets_for(opt, groundtruth));
+    if(n <= 1) return alignPairEval(gt);
 
-    alignedPairs();
+    collator ca(opt, sfn, hdr, n, "aligner");
+    collator cg(opt, gt.sfn, gt.hdr, n, "truth");
+    ca.run();
+    cg.run();
+
+    eval = eval_result();
+    report_writer *wrongFile = open_report("wrong.txt");
+    for(int i = 0; i < n; i++)
+    {
+        bamkit al(ca.buckets[i], opt);
+        bamkit g(cg.buckets[i], opt);
+        comparePairs(al, g, wrongFile);
+    }
+    delete wrongFile;
+    return printEval();
+}
+
+int bamkit::alignPairEval(bamkit &gt)
+{
+    eval = eval_result();
+    report_writer *wrongFile = open_report("wrong.txt");
+    comparePairs(*this, gt, wrongFile);
+    delete wrongFile;
+    return printEval();
+}
+
+// NULL unless --report_dir is given
+report_writer *bamkit::open_report(const string &name) const
+{
+    if(opt.report_dir == "") return NULL;
+    string path = opt.report_dir + "/" + name + (opt.report_compress ? ".gz" : "");
+    return new report_writer(path, opt.report_compress, opt.report_sample);
+}
+
+int bamkit::comparePairs(bamkit &al, bamkit &gt, report_writer *wrongFile)
+{
+    al.alignedPairs();
     gt.alignedPairs();
     
     set<rcdIdentifier> commonSet, unalignedSet, wrongSet;
-    set_intersection(gt.alignPairSet.begin(), gt.alignPairSet.end(), alignPairSet.begin(), alignPairSet.end(), inserter(commonSet, commonSet.begin()));
-    set_difference(gt.alignPairSet.begin(), gt.alignPairSet.end(), alignPairSet.begin(), alignPairSet.end(), inserter(unalignedSet, unalignedSet.begin()));
-    set_difference(alignPairSet.begin(), alignPairSet.end(), gt.alignPairSet.begin(), gt.alignPairSet.end(), inserter(wrongSet, wrongSet.begin()));
-
+    set_intersection(gt.alignPairSet.begin(), gt.alignPairSet.end(), al.alignPairSet.begin(), al.alignPairSet.end(), inserter(commonSet, commonSet.begin()));
+    set_difference(gt.alignPairSet.begin(), gt.alignPairSet.end(), al.alignPairSet.begin(), al.alignPairSet.end(), inserter(unalignedSet, unalignedSet.begin()));
+    set_difference(al.alignPairSet.begin(), al.alignPairSet.end(), gt.alignPairSet.begin(), gt.alignPairSet.end(), inserter(wrongSet, wrongSet.begin()));
 
-    //FILE * commonFile = fopen("common.txt", "w");
-    FILE * wrongFile = fopen("wrong.txt", "w");
     for(auto it = commonSet.begin(); it != commonSet.end(); it++)
     {
-        alignEvalMap[hitIndexRevMap[*it]] = true;
-        //fprintf(commonFile, "%s HI:%d\n", hitIndexRevMap[*it].first.c_str(), hitIndexRevMap[*it].second);
+        auto r = al.hitIndexRevMap.find(*it);
+        if(r != al.hitIndexRevMap.end()) al.alignEvalMap[r->second] = true;
     }
 
-    for(auto it = wrongSet.begin(); it != wrongSet.end(); it++)
+    for(auto it = wrongSet.begin(); wrongFile != NULL && it != wrongSet.end(); it++)
     {
-        fprintf(wrongFile, "%s HI:%d\n", hitIndexRevMap[*it].first.c_str(), hitIndexRevMap[*it].second);
+        if(wrongFile->sample(it->first) == false) continue;
+        auto r = al.hitIndexRevMap.find(*it);
+        if(r != al.hitIndexRevMap.end()) wrongFile->printf("%s HI:%d\n", r->second.first.c_str(), r->second.second);
     }
-    //fclose(commonFile);
-    fclose(wrongFile);
+
+    // one entry per aligned record of the file, so only kept for bridgeEval
+    if(&al != this && keep_eval == true) alignEvalMap.insert(al.alignEvalMap.begin(), al.alignEvalMap.end());
     
-    uint32_t common = commonSet.size(),unaligned = unalignedSet.size(), wrong = wrongSet.size();
-    uint32_t totalGT = gt.alignPairSet.size(), totalAligner = alignPairSet.size();    
-    float sensitivity = 1.0*common/totalGT;
-    float precision = 1.0*common/totalAligner;
-    printf("Total of ground truth:%d\nTotal of aligner:%d\nTrue alignment:%d\nFalse alignment:%d\n",totalGT, totalAligner, common, wrong);
-    printf("Aligner Sensitivity:%.4f\nAligner Precision:%.4f\n", sensitivity, precision);
+    eval.common += commonSet.size();
+    eval.wrong += wrongSet.size();
+    eval.totalGT += gt.alignPairSet.size();
+    eval.totalAligner += al.alignPairSet.size();
+    return 0;
+}
+
+int bamkit::printEval()
+{
+    eval.sensitivity = 1.0*eval.common/eval.totalGT;
+    eval.precision = 1.0*eval.common/eval.totalAligner;
+    if(opt.verbose <= 0) return 0;
+    printf("Total of ground truth:%d\nTotal of aligner:%d\nTrue alignment:%d\nFalse alignment:%d\n",eval.totalGT, eval.totalAligner, eval.common, eval.wrong);
+    printf("Aligner Sensitivity:%.4f\nAligner Precision:%.4f\n", eval.sensitivity, eval.precision);
     return 0;
 }
 
@@ -253,7 +486,6 @@ int bamkit::alignedPairs()
     hitIndexMap.clear();
     hitIndexRevMap.clear();
     alignPairSet.clear();
-    library_type = FR_SECOND;//flux simulated data is FRsecond
     while(sam_read1(sfn,hdr,b1t) >= 0)
     {
         string qname = bam_get_qname(b1t);
@@ -263,53 +495,50 @@ int bamkit::alignedPairs()
         if((p.flag & 0x4) >= 1) continue;
         //if((p.flag & 0x100) >= 1) continue;
 
-        string cigarStr = "";
-        for(int i=0; i < p.n_cigar;++i)
-        {
-            int icigar = cigar[i];
-            cigarStr=cigarStr + to_string(bam_cigar_oplen(icigar)) + bam_cigar_opchr(icigar);
-        }
+        cigar_key cigarKey(cigar, p.n_cigar);
         
-        hit ht(b1t, 4);
+        hit ht(b1t, 4, library<FR_SECOND>());//flux simulated data is FRsecond
         pair<string, uint32_t> key = make_pair(qname, ht.hi);
         alignEvalMap[key] = false;
         if(((p.flag & 0x40) >= 1 && ht.strand == '+') || ((p.flag & 0x80) >= 1 && ht.strand == '-'))//first segment
         {
             if(hitIndexMap.find(key) == hitIndexMap.end())
             {
-                hitIndexMap[key] = make_pair(make_pair(p.pos, cigarStr), make_pair(-1, ""));
+                hitIndexMap[key] = make_pair(make_pair(p.pos, cigarKey), make_pair(-1, cigar_key()));
             }
             else
             {
-                hitIndexMap[key].first = make_pair(p.pos, cigarStr);
+                hitIndexMap[key].first = make_pair(p.pos, cigarKey);
             }
         }
         else if(((p.flag & 0x40) >= 1 && ht.strand == '-') || ((p.flag & 0x80) >= 1 && ht.strand == '+'))
         {
             if(hitIndexMap.find(key) == hitIndexMap.end())
             {
-                hitIndexMap[key] = make_pair(make_pair(-1, ""), make_pair(p.pos, cigarStr));
+                hitIndexMap[key] = make_pair(make_pair(-1, cigar_key()), make_pair(p.pos, cigarKey));
             }
             else
             {
-                hitIndexMap[key].second = make_pair(p.pos, cigarStr);
+                hitIndexMap[key].second = make_pair(p.pos, cigarKey);
             }
         }
     }
 
     for(auto it = hitIndexMap.begin(); it != hitIndexMap.end(); it++)
     {
-        //printf("%s HI:%d [(%d, %s), (%d, %s)]\n", (it->first).first.c_str(), (it->first).second, (it->second).first.first, (it->second).first.second.c_str(), (it->second).second.first, (it->second).second.second.c_str());
+        //printf("%s HI:%d [(%d, %s), (%d, %s)]\n", (it->first).first.c_str(), (it->first).second, (it->second).first.first, (it->second).first.second.str().c_str(), (it->second).second.first, (it->second).second.second.str().c_str());
         string qname = (it->first).first;
         hitIndexRevMap[make_pair(qname, it->second)] = it->first;
         alignPairSet.insert(make_pair(qname, it->second));
     }
+    return 0;
 }
 
 
-int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, const string &annotation)
+int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, const string &gtfFile)
 {
-    bamkit aligner(alignerBam);
+    bamkit aligner(alignerBam, opt);
+    aligner.keep_eval = true;
     aligner.alignPairEval(groundTruthBam);
     alignEvalMap = aligner.alignEvalMap;
     /*for(auto it = alignEvalMap.begin(); it != alignEvalMap.end(); it++)
@@ -318,65 +547,12 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
     }
     cout << "lala" << endl;*/
 
-    map< string, set< pair<uint32_t,uint32_t> > > exonMap;
-    ifstream fin(annotation);
-
-    string line;
-    while(getline(fin, line))
-    {
-        stringstream liness(line);
-
-        string chrid;
-        string source;
-        string type;
-        getline(liness, chrid, '\t');
-        getline(liness, source, '\t');
-        getline(liness, type, '\t');
-        if(type == "exon")
-        {
-            string startss, endss, score, strand, frame, info;
-            getline(liness, startss, '\t');
-            getline(liness, endss, '\t');
-            getline(liness, score, '\t');
-            getline(liness, strand, '\t');
-            getline(liness, frame, '\t');
-            getline(liness, info, '\t');
-            
-            uint32_t start = stoi(startss);
-            uint32_t end = stoi(endss);
-            
-            stringstream infoss(info);
-            string tid;
-            while(getline(infoss,tid, ' ') && tid != "transcript_id");
-            getline(infoss, tid, ' ');
-            if(tid[0] == '\"')
-            {
-                tid.erase(tid.begin());
-                if(tid.back() == ';')
-                    tid.erase(tid.end()-2, tid.end());
-            }
-
-            if(exonMap.find(tid) == exonMap.end())
-            {
-                set< pair<uint32_t, uint32_t> > s;
-                s.insert(make_pair(start-1, end));//0-based, half-open
-                exonMap[tid] = s;
-                //printf("%s: (%d, %d)\n", tid.c_str(), start, end);
-            }
-            else
-            {
-                exonMap[tid].insert(make_pair(start-1,end));//0-based, half-open
-                //printf("%s: (%d, %d)\n", tid.c_str(), start, end);
-            }
-        }
-    }
-
+    annotation gtf(gtfFile);
 
     //build ground truth bridge
     //assume the ground-truth bam is FR-first: R1+,R2-
     //fragment:[pos, rpos)
-    bamkit gt(groundTruthBam);
-    map< string, pair<uint32_t, string> > bridgeMap;//qname->(start, cigar)
+    bamkit gt(groundTruthBam, opt);
     map< string, pair< pair<uint32_t,uint32_t>, pair<uint32_t,uint32_t> > >fragmentMap;//qname->(p1_start,p1_end, p2_start,p2_end)
     string qname;
     while(sam_read1(gt.sfn, gt.hdr, gt.b1t) >= 0)
@@ -402,61 +578,67 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
         //printf("%s: (%d, %d)\n", qname.c_str(), fragmentMap[qname].first.first, fragmentMap[qname].second.second);
     }
 
-    map<string, bool> challengeReads;
+    // fragments are sorted by name; bridges are derived in parallel
+    vector<string> fragments;
+    vector< pair< pair<uint32_t,uint32_t>, pair<uint32_t,uint32_t> > > mates;
     for(auto it = fragmentMap.begin(); it != fragmentMap.end(); it++)
-    {   
-        challengeReads[it->first] = false;
-        stringstream qnamess(it->first);
-        string chr, locus, tr;
-        getline(qnamess, chr, ':');
-        getline(qnamess, locus, ':');
-        getline(qnamess, tr, ':');
-        //cout << tr << endl;
-        uint32_t brStart = ((it->second).first).first, brEnd = ((it->second).second).second;
-        uint32_t brGapStart = ((it->second).first).second, brGapEnd = ((it->second).second).first;
-        uint32_t p1 = brStart, p2 = brStart;
-        //printf("Paired read: (%d, %d)\n", brStart, brEnd);
-        string newCigar = "";
-        for(auto it2 = exonMap[tr].begin(); it2 != exonMap[tr].end() && p2<brEnd; it2++)
-        {
-            //printf("Exon: (%d, %d)\n", it2->first, it2->second);
-            if(brStart>it2->second) continue;
+    {
+        fragments.push_back(it->first);
+        mates.push_back(it->second);
+    }
 
-            p1 = max(p2, it2->first);
-            if(p1-p2>0)
+    vector<int32_t> bridgeStart(fragments.size());
+    vector<cigar_key> bridgeCigar(fragments.size());
+    vector<char> challengeReads(fragments.size(), false);
+    vector<thread> workers;
+    int t = opt.threads;
+    for(int w = 0; w < t; w++)
+    {
+        workers.push_back(thread([&, w, t]()
+        {
+            for(int k = w; k < fragments.size(); k += t)
             {
-                newCigar = newCigar+ to_string(p1-p2) + "N";
-                if(p2>brGapStart && p1<=brGapEnd)
-                    challengeReads[it->first] = true;
+                stringstream qnamess(fragments[k]);
+                string chr, locus, tr;
+                getline(qnamess, chr, ':');
+                getline(qnamess, locus, ':');
+                getline(qnamess, tr, ':');
+                uint32_t brStart = mates[k].first.first, brEnd = mates[k].second.second;
+                uint32_t brGapStart = mates[k].first.second, brGapEnd = mates[k].second.first;
+                bool challenge;
+                vector<uint32_t> cigar;
+                gtf.bridge(gtf.find(tr), brStart, brEnd, brGapStart, brGapEnd, cigar, challenge);
+                bridgeCigar[k] = cigar_key(cigar.data(), cigar.size());
+                bridgeStart[k] = brStart;
+                challengeReads[k] = challenge;
             }
-
-            p2 = min(brEnd, it2->second);
-            if(p2-p1>0)
-                newCigar = newCigar+ to_string(p2-p1)+"M";
-            //printf("p1: %d; p2: %d; %s\n", p1, p2, newCigar.c_str());
-        }
-        bridgeMap[it->first] = make_pair(brStart, newCigar);
-        //printf("%s: (%d, %s)\n", (it->first).c_str(), brStart, newCigar.c_str());
+        }));
     }
-    
+    for(int w = 0; w < workers.size(); w++) workers[w].join();
+
     uint64_t cntTotalTruth = fragmentMap.size(), cntBridged = 0, cntBridgedCorrect = 0;
     uint64_t unbridged = 0, trueBrFalseAl = 0, trueBrTrueAl = 0, falseBrFalseAl = 0, falseBrTrueAl = 0;
     uint64_t unBrTrueAl = 0, unBrFalseAl = 0;
     uint64_t trueBrUnal = 0, falseBrUnal = 0, unBrUnal = 0;
     uint64_t unBrTrueAlCha = 0,unBrFalseAlCha = 0, trueBrFalseAlCha = 0, trueBrTrueAlCha = 0, falseBrFalseAlCha = 0, falseBrTrueAlCha = 0;
     uint32_t *cigar;
-    FILE * matchFile = fopen ("trueBrFalseAl.txt","w");
-    FILE * mismatchFile = fopen("falseBrTrueAl.txt", "w");
+    cigar_key noBridge;
+    report_writer *matchFile = open_report("trueBrFalseAl.txt");
+    report_writer *mismatchFile = open_report("falseBrTrueAl.txt");
     //cout << "lib: " << library_type << endl;
     while(sam_read1(sfn, hdr, b1t) >= 0)
     {
         qname = bam_get_qname(b1t);
         bam1_core_t &p = b1t->core;
-        hit ht(b1t, 4);
+        hit ht(b1t, 4, library<FR_SECOND>());
         pair<string, int32_t> key = make_pair(qname, ht.hi);
         //printf("[%s, HI:%d]\n", key.first.c_str(), key.second);
         
         if((p.flag & 0x4) >= 1) continue;
+
+        vector<string>::iterator fit = lower_bound(fragments.begin(), fragments.end(), qname);
+        int fr = (fit != fragments.end() && *fit == qname) ? (fit - fragments.begin()) : -1;
+        bool challenge = (fr >= 0 && challengeReads[fr]);
         //if((p.flag & 0x100) >= 1) continue;
         
         if(p.mpos != 0) 
@@ -468,12 +650,12 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
                 else if(alignEvalMap[key])
                 {
                     unBrTrueAl++;
-                    if(challengeReads[qname]) unBrTrueAlCha++;
+                    if(challenge) unBrTrueAlCha++;
                 }
                 else
                 {
                     unBrFalseAl++;
-                    if(challengeReads[qname]) unBrFalseAlCha++;
+                    if(challenge) unBrFalseAlCha++;
                 }
                 unbridged++;
 
@@ -484,30 +666,27 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
 
         //cout << p.n_cigar << endl;
         cigar = bam_get_cigar(b1t);
-        string cigarStr = "";
-        for(int i=0; i < p.n_cigar;++i)
-        {
-            int icigar = cigar[i];
-            cigarStr=cigarStr + to_string(bam_cigar_oplen(icigar)) + bam_cigar_opchr(icigar);
-        }
+        cigar_key cigarKey(cigar, p.n_cigar);
+        int32_t bridgePos = (fr >= 0) ? bridgeStart[fr] : 0;
+        const cigar_key &bridgeKey = (fr >= 0) ? bridgeCigar[fr] : noBridge;
 
-        if(bridgeMap[qname].first == p.pos && bridgeMap[qname].second == cigarStr)
+        if(fr >= 0 && bridgePos == p.pos && bridgeKey == cigarKey)
         {
             if(alignEvalMap.find(key) == alignEvalMap.end())
                 trueBrUnal++;
             else if(alignEvalMap[key])
             {
                 trueBrTrueAl++;
-                if(challengeReads[qname]) trueBrTrueAlCha++;
+                if(challenge) trueBrTrueAlCha++;
             }
             else
             {
                 trueBrFalseAl++;
-                if(challengeReads[qname]) trueBrFalseAlCha++;
-                fprintf(matchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgeMap[qname].first, bridgeMap[qname].second.c_str(), ht.hi, p.pos, cigarStr.c_str());
+                if(challenge) trueBrFalseAlCha++;
+                if(matchFile != NULL && matchFile->sample(qname)) matchFile->printf("%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgePos, bridgeKey.str().c_str(), ht.hi, p.pos, cigar_string(cigar, p.n_cigar).c_str());
             }
             cntBridgedCorrect++;
-            //fprintf(matchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgeMap[qname].first, bridgeMap[qname].second.c_str(), ht.hi, p.pos, cigarStr.c_str());
+            //fprintf(matchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgePos, bridgeKey.str().c_str(), ht.hi, p.pos, cigar_string(cigar, p.n_cigar).c_str());
         }
         else
         {
@@ -516,20 +695,20 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
             else if(alignEvalMap[key])
             {
                 falseBrTrueAl++;
-                if(challengeReads[qname]) falseBrTrueAlCha++;
-                fprintf(mismatchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgeMap[qname].first, bridgeMap[qname].second.c_str(), ht.hi, p.pos, cigarStr.c_str());
+                if(challenge) falseBrTrueAlCha++;
+                if(mismatchFile != NULL && mismatchFile->sample(qname)) mismatchFile->printf("%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgePos, bridgeKey.str().c_str(), ht.hi, p.pos, cigar_string(cigar, p.n_cigar).c_str());
             }
             else
             {
                 falseBrFalseAl++;
-                if(challengeReads[qname]) falseBrFalseAlCha++;
+                if(challenge) falseBrFalseAlCha++;
             }
-            //fprintf(mismatchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgeMap[qname].first, bridgeMap[qname].second.c_str(), ht.hi, p.pos, cigarStr.c_str());
+            //fprintf(mismatchFile, "%s:\nGT:(%d, %s)\tCoral:(HI:%d, %d, %s)\n",qname.c_str(), bridgePos, bridgeKey.str().c_str(), ht.hi, p.pos, cigar_string(cigar, p.n_cigar).c_str());
         }
 
     }
-    fclose(matchFile);
-    fclose(mismatchFile);
+    delete matchFile;
+    delete mismatchFile;
 
     float sensitivity = 1.0*cntBridgedCorrect/cntTotalTruth;
     float precision = 1.0*cntBridgedCorrect/cntBridged;
@@ -542,80 +721,277 @@ int bamkit::bridgeEval(const string &alignerBam, const string &groundTruthBam, c
 }
 
 
+template<int L>
 int bamkit::addXS(const string &file)
 {
-	samFile *fout = sam_open(file.c_str(), "w");
+	// with a reference, spliced reads take the strand of their intron motifs
+	packed_genome *genome = NULL;
+	if(opt.reference != "") genome = new packed_genome(opt.reference, hdr);
 
-	int f = sam_hdr_write(fout, hdr);
-	if(f < 0) printf("fail to write header to %s\n", file.c_str());
-	if(f < 0) exit(0);
+	// records are decoded here, compressed by the writer thread and the shared pool
+	async_writer fout(opt, file, hdr);
+	progress_meter *meter = open_progress();
+	int64_t n = 0;
 
-    library_type = FR_SECOND;
     while(sam_read1(sfn, hdr, b1t) >= 0)
 	{
+		if(meter != NULL && ++n % PROGRESS_PERIOD == 0) meter->update(sfn, PROGRESS_PERIOD);
 		uint8_t *p = bam_aux_get(b1t, "XS");
 
         if(!p || (*p) != 'A')
         {
             char XS = '.';
-            hit ht(b1t, 2);
-            XS = ht.strand;
-            f = bam_aux_append(b1t, "XS", 'A', sizeof(XS), (uint8_t *) &XS);
+			bam1_core_t &c = b1t->core;
+			if(genome == NULL || (c.flag & 0x4) >= 1 || c.n_cigar < 3 || c.n_cigar > MAX_NUM_CIGAR)
+			{
+				hit ht(b1t, 2, library<L>());
+				XS = ht.strand;
+			}
+			else
+			{
+				hit ht(b1t, 5, library<L>());
+				XS = splice_strand(ht, *genome);
+				if(XS == 0) XS = ht.strand;
+			}
+            int f = bam_aux_append(b1t, "XS", 'A', sizeof(XS), (uint8_t *) &XS);
 			if(f != 0) printf("fail to append XS\n");
 			if(f != 0) exit(0);
 		}
 
-		f = sam_write1(fout, hdr, b1t);
-		if(f < 0) printf("fail write alignment to %s\n", file.c_str());
-		if(f < 0) exit(0);
+		fout.write(b1t);
 	}
 
-	sam_close(fout);
+	fout.close();
+	if(meter != NULL) meter->update(sfn, n % PROGRESS_PERIOD);
+	if(meter != NULL) delete meter;
+	if(genome != NULL) delete genome;
 	return 0;
 }
 
+// strand agreed by the canonical motifs of the junctions of ht, '.' if they disagree, 0 if none
+char bamkit::splice_strand(hit &ht, const packed_genome &genome) const
+{
+	ht.build_splice_positions(opt);
+
+	char s = 0;
+	for(int i = 0; i < ht.spos.size(); i++)
+	{
+		char m = genome.motif(ht.tid, high32(ht.spos[i]), low32(ht.spos[i]));
+		if(m == '.') continue;
+		if(s != 0 && s != m) return '.';
+		s = m;
+	}
+	return s;
+}
+
+template<int L>
 int bamkit::splitByEnd(const string &file1, const string &file2)//by first and second segments
 {
-    samFile *fout1 = sam_open(file1.c_str(), "w");
-    samFile *fout2 = sam_open(file2.c_str(), "w");
-    
-    library_type = FR_SECOND;
-    int f = sam_hdr_write(fout1, hdr);
-	if(f < 0) printf("fail to write header to %s\n", file1.c_str());
-	if(f < 0) exit(0);
-    
-    f = sam_hdr_write(fout2, hdr);
-	if(f < 0) printf("fail to write header to %s\n", file2.c_str());
-	if(f < 0) exit(0);
+    async_writer fout1(opt, file1, hdr);
+    async_writer fout2(opt, file2, hdr);
 
     while(sam_read1(sfn, hdr, b1t) >= 0)
     {
         bam1_core_t &p = b1t->core;
-        hit ht(b1t, 4);
+        hit ht(b1t, 4, library<L>());
         if(((p.flag & 0x40) >= 1 && ht.strand == '+') || ((p.flag & 0x80) >= 1 && ht.strand == '-'))
         {
-            f = sam_write1(fout1, hdr, b1t);
-		    if(f < 0) printf("fail write alignment to %s\n", file1.c_str());
-		    if(f < 0) exit(0);
-
+            fout1.write(b1t);
         }
         else if(((p.flag & 0x40) >= 1 && ht.strand == '-') || ((p.flag & 0x80) >= 1 && ht.strand == '+'))
         {
-            f = sam_write1(fout2, hdr, b1t);
-		    if(f < 0) printf("fail write alignment to %s\n", file2.c_str());
-		    if(f < 0) exit(0);
+            fout2.write(b1t);
+        }
+    }
+    fout1.close();
+    fout2.close();
+    return 0;
+}
+
+template<int L>
+bool bamkit::split_key(int by, string &key)
+{
+    bam1_core_t &p = b1t->core;
+    if(by == SPLIT_PAIRING)
+    {
+        key = (p.mpos == 0) ? "single" : "paired";
+        return true;
+    }
+    if(by == SPLIT_CONTIG)
+    {
+        key = (p.tid >= 0 && p.tid < hdr->n_targets) ? hdr->target_name[p.tid] : "unmapped";
+        return true;
+    }
+    if(by == SPLIT_RG)
+    {
+        uint8_t *x = bam_aux_get(b1t, "RG");
+        key = (x && (*x) == 'Z') ? bam_aux2Z(x) : "none";
+        return true;
+    }
+    if(by == SPLIT_NH)
+    {
+        uint8_t *x = bam_aux_get(b1t, "NH");
+        key = (x && bam_aux2i(x) >= 2) ? "multi" : "unique";
+        return true;
+    }
+
+    hit ht(b1t, 3, library<L>());
+    if(by == SPLIT_STRAND)
+    {
+        if(ht.strand == '+') key = "plus";
+        else if(ht.strand == '-') key = "minus";
+        else key = "unknown";
+        return true;
+    }
+
+    // SPLIT_END, as in splitByEnd
+    if(((p.flag & 0x40) >= 1 && ht.strand == '+') || ((p.flag & 0x80) >= 1 && ht.strand == '-')) key = "first";
+    else if(((p.flag & 0x40) >= 1 && ht.strand == '-') || ((p.flag & 0x80) >= 1 && ht.strand == '+')) key = "second";
+    else return false;
+    return true;
+}
+
+/*
+ RG IDs and contig names may hold '/' or other characters that are not safe in
+ a file name: keep [A-Za-z0-9_-] and '.' (except a leading one), replace the rest by '_'
+*/
+string split_name(const string &key)
+{
+	string s = key;
+	for(int i = 0; i < s.size(); i++)
+	{
+		char c = s[i];
+		if(isalnum((unsigned char)c) || c == '_' || c == '-') continue;
+		if(c == '.' && i > 0) continue;
+		s[i] = '_';
+	}
+	if(s.size() == 0) s = "_";
+	return s;
+}
+
+// open outputs of split within --memory
+int bamkit::split_writers() const
+{
+	int64_t n = ((int64_t)(opt.memory) << 20) / SPLIT_WRITER_BYTES;
+	if(n > SPLIT_MAX_WRITERS) n = SPLIT_MAX_WRITERS;
+	if(n < 1) n = 1;
+	return n;
+}
 
+template<int L>
+int bamkit::split(const string &criterion, const string &prefix)
+{
+    int by = -1;
+    if(criterion == "end") by = SPLIT_END;
+    if(criterion == "pairing") by = SPLIT_PAIRING;
+    if(criterion == "strand") by = SPLIT_STRAND;
+    if(criterion == "rg") by = SPLIT_RG;
+    if(criterion == "contig") by = SPLIT_CONTIG;
+    if(criterion == "nh") by = SPLIT_NH;
+    if(by == -1) printf("unknown split criterion %s\n", criterion.c_str());
+    if(by == -1) exit(0);
+
+    // one writer (and thread) per key, created on first use; keys that
+    // collide once made safe get a numeric suffix; at most split_writers()
+    // are open, the least recently used is closed for a new key and its
+    // file is appended to when the key comes back
+    int cap = split_writers();
+    map<string, async_writer*> writers;		// open
+    map<string, string> files;				// of every key
+    map<string, int64_t> counts;			// records in closed writers
+    map<string, int64_t> used;				// when a key was last left
+    set<string> names;
+    bool renamed = false;
+    int64_t reopened = 0;
+    int64_t t = 0;
+    string key;
+    string last;
+    async_writer *w = NULL;
+    while(sam_read1(sfn, hdr, b1t) >= 0)
+    {
+        if(split_key<L>(by, key) == false) continue;
+        t++;
+        if(w == NULL || key != last)
+        {
+            if(w != NULL) used[last] = t;
+            map<string, async_writer*>::iterator it = writers.find(key);
+            if(it == writers.end() && writers.size() >= cap)
+            {
+                map<string, async_writer*>::iterator v = writers.begin();
+                for(map<string, async_writer*>::iterator x = writers.begin(); x != writers.end(); x++)
+                {
+                    if(used[x->first] < used[v->first]) v = x;
+                }
+                v->second->close();
+                counts[v->first] += v->second->records;
+                delete v->second;
+                writers.erase(v);
+            }
+            if(it == writers.end())
+            {
+                bool append = (files.find(key) != files.end());
+                if(append == false)
+                {
+                    string name = split_name(key);
+                    for(int k = 1; names.find(name) != names.end(); k++) name = split_name(key) + "." + to_string(k);
+                    names.insert(name);
+                    if(name != key) renamed = true;
+                    files[key] = prefix + "." + name + output_extension(opt);
+                }
+                if(append == true) reopened++;
+                it = writers.insert(make_pair(key, new async_writer(opt, files[key], hdr, append))).first;
+            }
+            w = it->second;
+            last = key;
         }
+        w->write(b1t);
     }
-    sam_close(fout1);
-    sam_close(fout2);
+
+    for(map<string, async_writer*>::iterator it = writers.begin(); it != writers.end(); it++)
+    {
+        it->second->close();
+        counts[it->first] += it->second->records;
+        delete it->second;
+    }
+    if(reopened >= 1 && opt.verbose >= 1) printf("more than %d outputs are interleaved, %ld were reopened\n", cap, reopened);
+
+    // the original key of every output, when some were renamed
+    ofstream fkeys;
+    if(renamed) fkeys.open(prefix + ".keys.tsv");
+    if(renamed && fkeys.fail()) printf("could not open %s.keys.tsv\n", prefix.c_str());
+    if(renamed && fkeys.fail()) exit(0);
+
+    for(map<string, string>::iterator it = files.begin(); it != files.end(); it++)
+    {
+        if(opt.verbose >= 1) printf("%s: %ld alignments\n", it->second.c_str(), counts[it->first]);
+        if(renamed) fkeys << it->second << "\t" << it->first << "\n";
+    }
+    if(renamed) fkeys.close();
     return 0;
 }
 
+template int bamkit::addXS<UNSTRANDED>(const string &file);
+template int bamkit::addXS<FR_FIRST>(const string &file);
+template int bamkit::addXS<FR_SECOND>(const string &file);
+template int bamkit::splitByEnd<FR_FIRST>(const string &file1, const string &file2);
+template int bamkit::splitByEnd<FR_SECOND>(const string &file1, const string &file2);
+template int bamkit::split<UNSTRANDED>(const string &criterion, const string &prefix);
+template int bamkit::split<FR_FIRST>(const string &criterion, const string &prefix);
+template int bamkit::split<FR_SECOND>(const string &criterion, const string &prefix);
+
+// whether filter2ndAlign keeps b
+bool bamkit::filter_keep(const bam1_t *b) const
+{
+	if(opt.max_edit_distance >= 0 && edit_distance(b) > opt.max_edit_distance) return false;
+	if((b->core.flag & 0x100) >= 1) return false;
+	return true;
+}
 
 int bamkit::filter2ndAlign(const string &file)
 {
-	samFile *fout = sam_open(file.c_str(), "w");
+	if(opt.unordered == true && opt.threads >= 2 && bgzf_shards::applicable(sfn, this->file) == true) return filter_shards(file);
+
+	samFile *fout = open_output(opt, file);
 
 	int f = sam_hdr_write(fout, hdr);
 	if(f < 0) printf("fail to write header to %s\n", file.c_str());
@@ -623,53 +999,287 @@ int bamkit::filter2ndAlign(const string &file)
 
     while(sam_read1(sfn, hdr, b1t) >= 0)
 	{
-        bam1_core_t &p = b1t->core;
+        if(filter_keep(b1t) == false) continue;
 
-        if((p.flag & 0x100) <=0)
-        {
-            f = sam_write1(fout, hdr, b1t);
-		    if(f < 0) printf("fail write alignment to %s\n", file.c_str());
-		    if(f < 0) exit(0);
+        f = sam_write1(fout, hdr, b1t);
+        if(f < 0) printf("fail write alignment to %s\n", file.c_str());
+        if(f < 0) exit(0);
+	}
+
+	sam_close(fout);
+	return 0;
+}
+
+/*
+ filter2ndAlign over shards of the input; every thread collects kept
+ records in its own batch and hands full batches to the writer, so the
+ output is not in input order
+*/
+int bamkit::filter_shards(const string &file)
+{
+	async_writer fout(opt, file, hdr);
+	mutex mtx;
+	int t = opt.threads;
+	vector< vector<bam1_t*> > batches(t);
+	vector<int> sizes(t, 0);
+
+	bgzf_shards sh(this->file, hdr);
+	sh.build(bgzf_tell(sfn->fp.bgzf), t * SHARDS_PER_THREAD);
+	int f = sh.run(t, [&](int w, int k, bam1_t *b)
+	{
+		if(filter_keep(b) == false) return true;
+
+		vector<bam1_t*> &v = batches[w];
+		if(sizes[w] >= v.size()) v.push_back(bam_init1());
+		bam_copy1(v[sizes[w]++], b);
+		if(sizes[w] < WRITER_BATCH_SIZE) return true;
+
+		lock_guard<mutex> lock(mtx);
+		for(int k = 0; k < sizes[w]; k++) fout.write(v[k]);
+		sizes[w] = 0;
+		return true;
+	});
+	if(f < 0) printf("fail to read %s\n", this->file.c_str());
+	if(f < 0) exit(0);
+
+	for(int w = 0; w < t; w++)
+	{
+		for(int k = 0; k < sizes[w]; k++) fout.write(batches[w][k]);
+		for(int k = 0; k < batches[w].size(); k++) bam_destroy1(batches[w][k]);
+	}
+	fout.close();
+	return 0;
+}
+
+int bamkit::collate(const string &out)
+{
+	collator c(opt, sfn, hdr, collator::buckets_for(opt, file), "collate");
+	c.run();
+	c.write(out);
+	return 0;
+}
+
+/*
+ records of one read have to be adjacent (as aligners write them, or
+ after collate); only the current name group is held in memory
+*/
+int bamkit::pick_primary(const string &file)
+{
+	if(coordinate_sorted(hdr) == true && opt.verbose >= 1) printf("warning: %s is sorted by coordinate, run collate first\n", this->file.c_str());
+
+	async_writer fout(opt, file, hdr);
+	vector<bam1_t*> group;
+	int n = 0;
+	int64_t groups = 0, changed = 0;
+
+	while(true)
+	{
+		bool more = (sam_read1(sfn, hdr, b1t) >= 0);
+		if(n >= 1 && (more == false || strcmp(bam_get_qname(group[0]), bam_get_qname(b1t)) != 0))
+		{
+			changed += pick_group(group, n);
+			for(int i = 0; i < n; i++) fout.write(group[i]);
+			groups++;
+			n = 0;
 		}
+		if(more == false) break;
 
+		if(n >= group.size()) group.push_back(bam_init1());
+		bam_copy1(group[n], b1t);
+		n++;
 	}
 
-	sam_close(fout);
+	fout.close();
+	for(int i = 0; i < group.size(); i++) bam_destroy1(group[i]);
+
+	if(opt.verbose >= 1) printf("read groups = %ld rewritten alignments = %ld\n", groups, changed);
+	return 0;
+}
+
+/*
+ drops (or, with --junction_action flag, marks as QC failed) alignments
+ with an implausibly long junction for its anchors (verify_junctions)
+ and, with --min_junction_support k > 1, those with a junction of fewer
+ than k reads; the support is counted by a first pass over the file
+*/
+int bamkit::filter_junctions(const string &file)
+{
+	vector< pair<int32_t, int64_t> > supported;
+	if(opt.min_junction_support >= 2) count_junctions(supported);
+
+	async_writer fout(opt, file, hdr);
+	int64_t records = 0, longs = 0, weaks = 0;
+
+	while(sam_read1(sfn, hdr, b1t) >= 0)
+	{
+		records++;
+		bam1_core_t &p = b1t->core;
+		bool bad = false;
+		if((p.flag & 0x4) <= 0 && p.n_cigar >= 3 && p.n_cigar <= MAX_NUM_CIGAR)
+		{
+			hit ht(b1t, 5);
+			if(ht.verify_junctions(opt) == false)
+			{
+				bad = true;
+				longs++;
+			}
+
+			if(bad == false && opt.min_junction_support >= 2)
+			{
+				ht.build_splice_positions(opt);
+				for(int i = 0; i < ht.spos.size() && bad == false; i++)
+				{
+					bad = !binary_search(supported.begin(), supported.end(), make_pair(ht.tid, ht.spos[i]));
+				}
+				if(bad == true) weaks++;
+			}
+		}
+
+		if(bad == true && opt.junction_action == "drop") continue;
+		if(bad == true) p.flag |= 0x200;
+		fout.write(b1t);
+	}
+
+	fout.close();
+
+	if(opt.verbose >= 1) printf("alignments = %ld long junctions = %ld weak junctions = %ld %s\n",
+			records, longs, weaks, opt.junction_action == "drop" ? "dropped" : "flagged");
+	return 0;
+}
+
+// sorted junctions with at least --min_junction_support reads, by a separate pass
+int bamkit::count_junctions(vector< pair<int32_t, int64_t> > &supported)
+{
+	if(this->file == "" || this->file == "-") printf("Error: --min_junction_support needs a file, not a stream\n");
+	if(this->file == "" || this->file == "-") exit(0);
+
+	samFile *in = open_input(opt, this->file);
+	if(in == NULL) printf("fail to open %s\n", this->file.c_str());
+	if(in == NULL) exit(0);
+	bam_hdr_t *h = sam_hdr_read(in);
+
+	junction_collector jc(opt, h);
+	engine eg;
+	eg.push(&jc);
+	if(eg.run_shards(this->file, in, h, opt.threads) != 0) eg.run(in, h);
+
+	// a flat sorted array is all the second pass needs
+	supported.clear();
+	for(map<pair<int32_t, int64_t>, int>::const_iterator it = jc.junctions.begin(); it != jc.junctions.end(); it++)
+	{
+		if(it->second >= opt.min_junction_support) supported.push_back(it->first);
+	}
+
+	if(opt.verbose >= 2) printf("junctions = %lu supported by %d reads = %lu\n", jc.junctions.size(), opt.min_junction_support, supported.size());
+
+	bam_hdr_destroy(h);
+	sam_close(in);
 	return 0;
 }
 
+/*
+ alignments of a read are told apart by HI, so both mates of an alignment
+ share it; the one with the highest total AS (then lowest NM) becomes
+ primary. Without HI every segment picks its best record on its own.
+ Unmapped and supplementary records are left as they are. Returns the
+ number of records whose flag changed.
+*/
+// a record of the segment of group[i] whose SEQ fits the query of group[i], the primary if it does, or -1
+static int sequence_donor(const vector<bam1_t*> &group, int n, int i)
+{
+	const bam1_core_t &p = group[i]->core;
+	int64_t l = bam_cigar2qlen(p.n_cigar, bam_get_cigar(group[i]));
+	int d = -1;
+	for(int j = 0; j < n; j++)
+	{
+		const bam1_core_t &q = group[j]->core;
+		if(j == i || (q.flag & 0xC0) != (p.flag & 0xC0)) continue;
+		if(q.l_qseq <= 0 || q.l_qseq != l) continue;
+		if(d == -1 || (q.flag & 0x900) <= 0) d = j;
+	}
+	return d;
+}
+
+int bamkit::pick_group(vector<bam1_t*> &group, int n)
+{
+	// secondaries often have SEQ and QUAL as *, they are filled from another
+	// record of the segment when promoted, and are not promoted without one
+	vector<int64_t> as(n), nm(n), hi(n), donor(n, -1);
+	bool byhi = true;
+	for(int i = 0; i < n; i++)
+	{
+		as[i] = aux_integer(bam_aux_get(group[i], "AS"), 0);
+		nm[i] = max(edit_distance(group[i]), 0);
+		hi[i] = aux_integer(bam_aux_get(group[i], "HI"), -1);
+		if((group[i]->core.flag & 0x804) >= 1) continue;
+		if(group[i]->core.l_qseq <= 0) donor[i] = sequence_donor(group, n, i);
+		if(hi[i] < 0) byhi = false;
+	}
+
+	// a unit is an HI value, or a single record; units sum over their records
+	vector<int64_t> key(n);
+	map<int64_t, pair<int64_t, int64_t> > score;
+	map<int64_t, bool> primary;
+	set<int64_t> bare;
+	for(int i = 0; i < n; i++)
+	{
+		if((group[i]->core.flag & 0x804) >= 1) continue;
+		int seg = group[i]->core.flag & 0xC0;
+		key[i] = byhi ? hi[i] : i;
+		int64_t s = byhi ? 0 : seg;
+		pair<int64_t, int64_t> &x = score[pack(s, key[i])];
+		x.first += as[i];
+		x.second -= nm[i];
+		if((group[i]->core.flag & 0x100) <= 0) primary[pack(s, key[i])] = true;
+		if((group[i]->core.flag & 0x100) >= 1 && group[i]->core.l_qseq <= 0 && donor[i] < 0) bare.insert(pack(s, key[i]));
+	}
+
+	// best unit per segment (a single pseudo-segment 0 with HI)
+	map<int64_t, int64_t> best;
+	for(map<int64_t, pair<int64_t, int64_t> >::iterator it = score.begin(); it != score.end(); it++)
+	{
+		if(bare.find(it->first) != bare.end()) continue;
+		int64_t s = high32(it->first);
+		map<int64_t, int64_t>::iterator b = best.find(s);
+		if(b == best.end())
+		{
+			best[s] = it->first;
+			continue;
+		}
+		pair<int64_t, int64_t> &x = score[b->second];
+		bool p = primary.find(it->first) != primary.end();
+		bool q = primary.find(b->second) != primary.end();
+		if(it->second > x || (it->second == x && p == true && q == false)) b->second = it->first;
+	}
+
+	int changed = 0;
+	for(int i = 0; i < n; i++)
+	{
+		bam1_core_t &p = group[i]->core;
+		if((p.flag & 0x804) >= 1) continue;
+		int64_t s = byhi ? 0 : (p.flag & 0xC0);
+		map<int64_t, int64_t>::iterator b = best.find(s);
+		if(b == best.end()) continue;
+		uint16_t flag = (b->second == pack(s, key[i])) ? (p.flag & ~0x100) : (p.flag | 0x100);
+		if(flag != p.flag) changed++;
+		if((p.flag & 0x100) >= 1 && (flag & 0x100) <= 0 && p.l_qseq <= 0) copy_sequence(group[i], group[donor[i]]);
+		p.flag = flag;
+	}
+	return changed;
+}
+
 int bamkit::splitSinglePaired(const string &file1, const string &file2)//by first and second segments
 {
-    samFile *fout1 = sam_open(file1.c_str(), "w");
-    samFile *fout2 = sam_open(file2.c_str(), "w");
-    
-    int f = sam_hdr_write(fout1, hdr);
-	if(f < 0) printf("fail to write header to %s\n", file1.c_str());
-	if(f < 0) exit(0);
-    
-    f = sam_hdr_write(fout2, hdr);
-	if(f < 0) printf("fail to write header to %s\n", file2.c_str());
-	if(f < 0) exit(0);
+    async_writer fout1(opt, file1, hdr);
+    async_writer fout2(opt, file2, hdr);
 
     while(sam_read1(sfn, hdr, b1t) >= 0)
     {
         bam1_core_t &p = b1t->core;
-        if(p.mpos == 0)
-        {
-            f = sam_write1(fout1, hdr, b1t);
-		    if(f < 0) printf("fail write alignment to %s\n", file1.c_str());
-		    if(f < 0) exit(0);
-
-        }
-        else
-        {
-            f = sam_write1(fout2, hdr, b1t);
-		    if(f < 0) printf("fail write alignment to %s\n", file2.c_str());
-		    if(f < 0) exit(0);
-
-        }
+        if(p.mpos == 0) fout1.write(b1t);
+        else fout2.write(b1t);
     }
-    sam_close(fout1);
-    sam_close(fout2);
+    fout1.close();
+    fout2.close();
     return 0;
 }
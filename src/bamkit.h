@@ -2,6 +2,19 @@
 #define __BAMKIT_H__
 
 #include "hit.h"
+#include "collector.h"
+#include "engine.h"
+#include "cache.h"
+#include "writer.h"
+#include "collate.h"
+#include "mate.h"
+#include "dup.h"
+#include "basestats.h"
+#include "genecount.h"
+#include "genome.h"
+#include "edit.h"
+#include "annotation.h"
+#include "cigar.h"
 #include <set>
 #include <algorithm>
 #include <fstream>
@@ -11,45 +24,115 @@
 
 using namespace std;
 
-typedef pair<pair<int, string>, pair<int, string> > pairPosCigar;
+typedef pair<pair<int, cigar_key>, pair<int, cigar_key> > pairPosCigar;
 typedef pair<string, pairPosCigar> rcdIdentifier;
 
+// criteria of split
+#define SPLIT_END 0
+#define SPLIT_PAIRING 1
+#define SPLIT_STRAND 2
+#define SPLIT_RG 3
+#define SPLIT_CONTIG 4
+#define SPLIT_NH 5
+
+// outputs of split open at once, each with a thread and its queued batches
+#define SPLIT_MAX_WRITERS 256
+#define SPLIT_WRITER_BYTES (8 << 20)		// memory of one, about 5 batches of records
+
+// block sampling of --estimate
+#define ESTIMATE_SPAN (1 << 20)			// compressed bytes of a sampled shard
+#define ESTIMATE_MIN_SHARDS 32
+#define ESTIMATE_SEED 0x5eed
+
+// result of alignPairEval
+class eval_result
+{
+public:
+	eval_result();
+
+public:
+	uint32_t totalGT;			// pairs in the ground truth
+	uint32_t totalAligner;		// pairs reported by the aligner
+	uint32_t common;			// true alignments
+	uint32_t wrong;				// false alignments
+	float sensitivity;
+	float precision;
+};
+
 class bamkit
 {
 public:
-	bamkit(const string &bamfile);
+	bamkit(const string &bamfile, const options &opt);
+	bamkit(samFile *sfn, bam_hdr_t *hdr, const options &opt);	// caller keeps ownership
 	~bamkit();
 
 private:
+	options opt;
+	string file;		// empty for a caller-provided stream
+	bool owner;
 	samFile *sfn;
 	bam_hdr_t *hdr;
 	bam1_t *b1t;
 
-	int qcnt;			// single reads
-	double qlen;		// single reads
-	vector<int> ivec;	// insert size
-
     //evaluate aligners
     map<pair<string,int32_t>, bool > alignEvalMap;
+    bool keep_eval;		// gather alignEvalMap over all buckets (for bridgeEval)
     map<pair<string, int32_t>, pairPosCigar> hitIndexMap;
     map<rcdIdentifier, pair<string, int32_t> > hitIndexRevMap;
     set<rcdIdentifier> alignPairSet;
 
+public:
+	eval_result eval;
+
 public:
 	int solve_count();
 	int solve_strand();
-	int solve_fragment();;
+	int solve_fragment();
+	int solve_junction();
+	int solve_stats();
+	int solve_pairs();
+	int solve_dupstat();
+	int solve_basestats();
+	int solve_edits();
+	int solve_genecount(const string &gtfFile);
 	int ts2XS(const string &file);
 	int name2to1(const string &file);
     int alignPairEval(const string &groundtruth);
-    int bridgeEval(const string &alignerBam, const string &groundTruthBam, const string &annotation);
-    int addXS(const string &file);
-    int splitByEnd(const string &file1, const string &file2);
+    int alignPairEval(bamkit &gt);
+    int bridgeEval(const string &alignerBam, const string &groundTruthBam, const string &gtfFile);
+    template<int L> int addXS(const string &file);
+    template<int L> int splitByEnd(const string &file1, const string &file2);
     int filter2ndAlign(const string &file);
     int splitSinglePaired(const string &file1, const string &file2);
+    template<int L> int split(const string &criterion, const string &prefix);
+    int collate(const string &file);
+    int pick_primary(const string &file);
+    int filter_junctions(const string &file);
 
 private:
+    int scan(collector &c, const string &command);
+    int run(engine &eg);
+    template<int L> bool split_key(int by, string &key);
+    int split_writers() const;
+    int pick_group(vector<bam1_t*> &group, int n);
+    char splice_strand(hit &ht, const packed_genome &genome) const;
+    int count_junctions(vector< pair<int32_t, int64_t> > &supported);
+    bool filter_keep(const bam1_t *b) const;
+    int filter_shards(const string &file);
     int alignedPairs();
+    int comparePairs(bamkit &al, bamkit &gt, report_writer *wrongFile);
+    report_writer *open_report(const string &name) const;
+    progress_meter *open_progress() const;
+    int estimate(count_collector &cc);
+    int scan_scaled(count_collector &cc, const string &command);
+    int scale_sample(count_collector &cc);
+    int printEval();
 };
 
+// total over a file of total bytes from units of b bytes with values x, and half its 95% interval
+int ratio_interval(const vector<double> &x, const vector<double> &b, double total, double &estimate, double &half);
+
+// key of split made safe as part of a file name
+string split_name(const string &key);
+
 #endif
@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BASESTATS_X86
+#endif
+
+#include "basestats.h"
+
+// codes of C, G and N in the 4-bit encoding
+#define CODE_C 2
+#define CODE_G 4
+#define CODE_N 15
+
+static void count_bases_scalar(const uint8_t *seq, int nbytes, int64_t &gc, int64_t &n)
+{
+	for(int i = 0; i < nbytes; i++)
+	{
+		int x = seq[i] >> 4;
+		int y = seq[i] & 0xF;
+		gc += (x == CODE_C || x == CODE_G) + (y == CODE_C || y == CODE_G);
+		n += (x == CODE_N) + (y == CODE_N);
+	}
+}
+
+static int64_t add_qual_scalar(const uint8_t *qual, int n, uint32_t *sum)
+{
+	int64_t s = 0;
+	for(int i = 0; i < n; i++)
+	{
+		sum[i] += qual[i];
+		s += qual[i];
+	}
+	return s;
+}
+
+#ifdef BASESTATS_X86
+// 16 bytes, i.e., 32 bases, per iteration
+__attribute__((target("sse4.1,popcnt")))
+static void count_bases_sse4(const uint8_t *seq, int nbytes, int64_t &gc, int64_t &n)
+{
+	const __m128i mask = _mm_set1_epi8(0xF);
+	const __m128i c = _mm_set1_epi8(CODE_C);
+	const __m128i g = _mm_set1_epi8(CODE_G);
+	const __m128i t = _mm_set1_epi8(CODE_N);
+	int i = 0;
+	for(; i + 16 <= nbytes; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(seq + i));
+		__m128i lo = _mm_and_si128(v, mask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i xlo = _mm_or_si128(_mm_cmpeq_epi8(lo, c), _mm_cmpeq_epi8(lo, g));
+		__m128i xhi = _mm_or_si128(_mm_cmpeq_epi8(hi, c), _mm_cmpeq_epi8(hi, g));
+		gc += _mm_popcnt_u32(_mm_movemask_epi8(xlo)) + _mm_popcnt_u32(_mm_movemask_epi8(xhi));
+		n += _mm_popcnt_u32(_mm_movemask_epi8(_mm_cmpeq_epi8(lo, t))) + _mm_popcnt_u32(_mm_movemask_epi8(_mm_cmpeq_epi8(hi, t)));
+	}
+	count_bases_scalar(seq + i, nbytes - i, gc, n);
+}
+
+__attribute__((target("sse4.1")))
+static int64_t add_qual_sse4(const uint8_t *qual, int n, uint32_t *sum)
+{
+	__m128i total = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 16 <= n; i += 16)
+	{
+		__m128i q = _mm_loadu_si128((const __m128i*)(qual + i));
+		total = _mm_add_epi64(total, _mm_sad_epu8(q, _mm_setzero_si128()));
+		__m128i *p = (__m128i*)(sum + i);
+		_mm_storeu_si128(p + 0, _mm_add_epi32(_mm_loadu_si128(p + 0), _mm_cvtepu8_epi32(q)));
+		_mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), _mm_cvtepu8_epi32(_mm_srli_si128(q, 4))));
+		_mm_storeu_si128(p + 2, _mm_add_epi32(_mm_loadu_si128(p + 2), _mm_cvtepu8_epi32(_mm_srli_si128(q, 8))));
+		_mm_storeu_si128(p + 3, _mm_add_epi32(_mm_loadu_si128(p + 3), _mm_cvtepu8_epi32(_mm_srli_si128(q, 12))));
+	}
+	int64_t s = _mm_cvtsi128_si64(total) + _mm_extract_epi64(total, 1);
+	return s + add_qual_scalar(qual + i, n - i, sum + i);
+}
+
+// 32 bytes, i.e., 64 bases, per iteration
+__attribute__((target("avx2,popcnt")))
+static void count_bases_avx2(const uint8_t *seq, int nbytes, int64_t &gc, int64_t &n)
+{
+	const __m256i mask = _mm256_set1_epi8(0xF);
+	const __m256i c = _mm256_set1_epi8(CODE_C);
+	const __m256i g = _mm256_set1_epi8(CODE_G);
+	const __m256i t = _mm256_set1_epi8(CODE_N);
+	int i = 0;
+	for(; i + 32 <= nbytes; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(seq + i));
+		__m256i lo = _mm256_and_si256(v, mask);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+		__m256i xlo = _mm256_or_si256(_mm256_cmpeq_epi8(lo, c), _mm256_cmpeq_epi8(lo, g));
+		__m256i xhi = _mm256_or_si256(_mm256_cmpeq_epi8(hi, c), _mm256_cmpeq_epi8(hi, g));
+		gc += _mm_popcnt_u32(_mm256_movemask_epi8(xlo)) + _mm_popcnt_u32(_mm256_movemask_epi8(xhi));
+		n += _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, t))) + _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, t)));
+	}
+	count_bases_scalar(seq + i, nbytes - i, gc, n);
+}
+
+__attribute__((target("avx2")))
+static int64_t add_qual_avx2(const uint8_t *qual, int n, uint32_t *sum)
+{
+	__m256i total = _mm256_setzero_si256();
+	int i = 0;
+	for(; i + 32 <= n; i += 32)
+	{
+		__m256i q = _mm256_loadu_si256((const __m256i*)(qual + i));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(q, _mm256_setzero_si256()));
+		for(int k = 0; k < 4; k++)
+		{
+			__m128i x = _mm_loadl_epi64((const __m128i*)(qual + i + 8 * k));
+			__m256i *p = (__m256i*)(sum + i + 8 * k);
+			_mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), _mm256_cvtepu8_epi32(x)));
+		}
+	}
+	int64_t s = _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) + _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3);
+	return s + add_qual_scalar(qual + i, n - i, sum + i);
+}
+#endif
+
+base_kernels base_kernels::scalar()
+{
+	base_kernels k;
+	k.name = "scalar";
+	k.count_bases = count_bases_scalar;
+	k.add_qual = add_qual_scalar;
+	return k;
+}
+
+base_kernels base_kernels::select()
+{
+	base_kernels k = scalar();
+#ifdef BASESTATS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+	{
+		k.name = "avx2";
+		k.count_bases = count_bases_avx2;
+		k.add_qual = add_qual_avx2;
+	}
+	else if(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"))
+	{
+		k.name = "sse4.1";
+		k.count_bases = count_bases_sse4;
+		k.add_qual = add_qual_sse4;
+	}
+#endif
+	return k;
+}
+
+basestats_collector::basestats_collector(const options &o, bool d)
+	: collector(o), detail(d)
+{
+	reads = 0;
+	bases = 0;
+	gc = 0;
+	nn = 0;
+	qsum = 0;
+	pending = 0;
+	gcvec.assign(101, 0);
+	kernels = base_kernels::select();
+}
+
+bool basestats_collector::unmapped() const
+{
+	return true;
+}
+
+int basestats_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x900) >= 1) return 0;				// secondary or supplementary alignment
+	if(p.l_qseq <= 0) return 0;						// no sequence
+
+	int l = p.l_qseq;
+	int64_t g = 0, n = 0;
+	kernels.count_bases(bam_get_seq(b), (l + 1) / 2, g, n);
+
+	reads++;
+	bases += l;
+	gc += g;
+	nn += n;
+	if(l > n) gcvec[(int)(100.0 * g / (l - n) + 0.5)]++;
+
+	// qualities are absent
+	uint8_t *q = bam_get_qual(b);
+	if(q[0] == 0xff) return 0;
+
+	if(l >= lvec.size()) lvec.resize(l + 1, 0);
+	lvec[l]++;
+
+	// cycles run against the reference on the reverse strand
+	if((p.flag & 0x10) >= 1)
+	{
+		rev.resize(l);
+		reverse_copy(q, q + l, rev.begin());
+		q = rev.data();
+	}
+
+	if(l > acc.size()) acc.resize(l, 0);
+	qsum += kernels.add_qual(q, l, acc.data());
+
+	// 2^23 reads of quality < 256 fit in 32 bits
+	pending++;
+	if(pending >= (1 << 23)) flush();
+	return 0;
+}
+
+int basestats_collector::flush()
+{
+	if(acc.size() > cycle.size()) cycle.resize(acc.size(), 0);
+	for(int i = 0; i < acc.size(); i++)
+	{
+		cycle[i] += acc[i];
+		acc[i] = 0;
+	}
+	pending = 0;
+	return 0;
+}
+
+collector *basestats_collector::spawn() const
+{
+	return new basestats_collector(opt, detail);
+}
+
+// vector sums, grown to the longer of both
+static void add_to(vector<uint64_t> &x, const vector<uint64_t> &y)
+{
+	if(y.size() > x.size()) x.resize(y.size(), 0);
+	for(int i = 0; i < y.size(); i++) x[i] += y[i];
+}
+
+static void add_to(vector<int64_t> &x, const vector<int64_t> &y)
+{
+	if(y.size() > x.size()) x.resize(y.size(), 0);
+	for(int i = 0; i < y.size(); i++) x[i] += y[i];
+}
+
+int basestats_collector::merge(const collector &c)
+{
+	const basestats_collector &x = dynamic_cast<const basestats_collector&>(c);
+	reads += x.reads;
+	bases += x.bases;
+	gc += x.gc;
+	nn += x.nn;
+	qsum += x.qsum;
+	add_to(gcvec, x.gcvec);
+	add_to(lvec, x.lvec);
+	add_to(cycle, x.cycle);
+	add_to(cycle, vector<uint64_t>(x.acc.begin(), x.acc.end()));
+	return 0;
+}
+
+int basestats_collector::print() const
+{
+	basestats_collector *x = const_cast<basestats_collector*>(this);
+	x->flush();
+
+	int64_t qreads = 0, qbases = 0;
+	for(int i = 0; i < lvec.size(); i++) qreads += lvec[i];
+	for(int i = 0; i < lvec.size(); i++) qbases += lvec[i] * i;
+	printf("reads = %ld bases = %ld GC content = %.4lf N rate = %.6lf mean base quality = %.2lf (%s)\n",
+			reads, bases, (bases > nn ? 1.0 * gc / (bases - nn) : 0), (bases > 0 ? 1.0 * nn / bases : 0),
+			(qbases > 0 ? 1.0 * qsum / qbases : 0), kernels.name.c_str());
+	if(detail == false) return 0;
+
+	for(int i = 0; i < gcvec.size(); i++)
+	{
+		printf("GC\t%d\t%ld\n", i, gcvec[i]);
+	}
+
+	// reads covering cycle i are those longer than i
+	int64_t covering = qreads;
+	for(int i = 0; i < cycle.size(); i++)
+	{
+		if(i < lvec.size()) covering -= lvec[i];
+		if(covering <= 0) break;
+		printf("QUAL\t%d\t%.2lf\n", i + 1, 1.0 * cycle[i] / covering);
+	}
+	return 0;
+}
+
+string basestats_collector::json() const
+{
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"reads\":%ld,\"bases\":%ld,\"gc_bases\":%ld,\"n_bases\":%ld,\"quality_sum\":%ld}", reads, bases, gc, nn, qsum);
+	return string(buf);
+}
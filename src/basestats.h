@@ -0,0 +1,59 @@
+#ifndef __BASESTATS_H__
+#define __BASESTATS_H__
+
+#include "collector.h"
+
+using namespace std;
+
+// kernels over the 4-bit packed sequence and the quality array of a read
+class base_kernels
+{
+public:
+	string name;
+	// numbers of C/G and of N among the 2 * nbytes bases in seq
+	void (*count_bases)(const uint8_t *seq, int nbytes, int64_t &gc, int64_t &n);
+	// sum[i] += qual[i] for i < n, returns the sum of qual
+	int64_t (*add_qual)(const uint8_t *qual, int n, uint32_t *sum);
+
+public:
+	static base_kernels select();		// the best one the CPU supports
+	static base_kernels scalar();
+};
+
+/*
+ GC content, N rate and per-cycle base quality; per-cycle sums are kept
+ in 32-bit counters that are moved to 64-bit ones before they can overflow
+*/
+class basestats_collector: public collector
+{
+public:
+	basestats_collector(const options &opt, bool detail);
+
+public:
+	bool detail;						// print the histograms
+	int64_t reads;
+	int64_t bases;
+	int64_t gc;							// C/G bases
+	int64_t nn;							// N bases
+	int64_t qsum;						// sum of base qualities
+	vector<int64_t> gcvec;				// histogram of per-read GC percentage
+	vector<int64_t> lvec;				// lengths of reads with qualities
+	vector<uint64_t> cycle;				// sum of qualities per cycle
+
+public:
+	int add(bam1_t *b);
+	bool unmapped() const;
+	int print() const;
+	string json() const;
+	collector *spawn() const;
+	int merge(const collector &c);
+	int flush();						// move 32-bit counters to 64-bit ones
+
+private:
+	base_kernels kernels;
+	vector<uint32_t> acc;				// 32-bit per-cycle sums
+	int pending;						// reads in acc
+	vector<uint8_t> rev;				// buffer for reversed qualities
+};
+
+#endif
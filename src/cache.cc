@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+file_identity::file_identity()
+{
+	inode = 0;
+	size = -1;
+	mtime = -1;
+	tail = 0;
+}
+
+int file_identity::build(const string &file)
+{
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0) return -1;
+	if(S_ISREG(st.st_mode) == false) return -1;
+	inode = st.st_ino;
+	size = st.st_size;
+	mtime = st.st_mtime;
+	tail = hash_range(file, size);
+	return 0;
+}
+
+uint64_t file_identity::hash_range(const string &file, int64_t end) const
+{
+	int64_t start = (end > CACHE_TAIL_SIZE) ? end - CACHE_TAIL_SIZE : 0;
+	vector<char> buf(end - start);
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0) return 0;
+	ssize_t n = pread(fd, buf.data(), buf.size(), start);
+	close(fd);
+	if(n != buf.size()) return 0;
+
+	return hash64(buf.data(), buf.size(), end);
+}
+
+string file_identity::str() const
+{
+	ostringstream s;
+	s << inode << "\t" << size << "\t" << mtime << "\t" << tail;
+	return s.str();
+}
+
+string identity_key(const string &file)
+{
+	file_identity id;
+	id.build(file);
+	char buf[PATH_MAX];
+	string p = (realpath(file.c_str(), buf) == NULL) ? file : string(buf);
+	return p + "\t" + id.str();
+}
+
+result_cache::result_cache(const options &o, const string &f, const string &command)
+	: opt(o), file(f)
+{
+	if(opt.cache_dir == "") return;
+	if(id.build(file) != 0) return;
+
+	char buf[PATH_MAX];
+	if(realpath(file.c_str(), buf) == NULL) return;
+
+	// everything that changes the collected numbers
+	ostringstream key;
+	key << buf << "\t" << command << "\t" << opt.min_mapping_quality << "\t" << opt.use_second_alignment << "\t" << opt.min_flank_length << "\t" << opt.fraction << "\t" << opt.estimate;
+	string s = key.str();
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016lx.cache", hash64(s.c_str(), s.size()));
+	path = opt.cache_dir + "/" + name;
+}
+
+int result_cache::lookup(collector &c, int64_t &voffset)
+{
+	if(path == "") return 0;
+
+	ifstream fin(path.c_str());
+	if(fin.fail()) return 0;
+
+	string magic;
+	file_identity old;
+	if(!(fin >> magic >> old.inode >> old.size >> old.mtime >> old.tail >> voffset)) return 0;
+	if(magic != CACHE_MAGIC) return 0;
+	if(old.inode != id.inode) return 0;
+	if(old.size > id.size) return 0;
+
+	int r = 0;
+	if(old.size == id.size && old.mtime == id.mtime && old.tail == id.tail) r = 1;
+	else if(old.size < id.size && voffset >= 0 && id.hash_range(file, old.size) == old.tail) r = 2;
+	if(r == 0) return 0;
+
+	if(c.load(fin) != 0) return 0;
+	return r;
+}
+
+int result_cache::store(const collector &c, int64_t voffset)
+{
+	if(path == "") return 0;
+
+	string tmp = path + "." + tostring(getpid());
+	ofstream fout(tmp.c_str());
+	if(fout.fail()) return -1;
+
+	fout << CACHE_MAGIC << " " << id.inode << " " << id.size << " " << id.mtime << " " << id.tail << " " << voffset << "\n";
+	int f = c.save(fout);
+	fout.close();
+
+	if(f != 0 || fout.fail() || rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		unlink(tmp.c_str());
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "collector.h"
+
+using namespace std;
+
+#define CACHE_MAGIC "bamkit-cache-4"		// bumped whenever a saved state changes
+#define CACHE_TAIL_SIZE 65536
+
+// what identifies the content of an input file
+class file_identity
+{
+public:
+	file_identity();
+
+public:
+	uint64_t inode;
+	int64_t size;
+	int64_t mtime;
+	uint64_t tail;						// hash of the last CACHE_TAIL_SIZE bytes (incl. the EOF block)
+
+public:
+	int build(const string &file);
+	uint64_t hash_range(const string &file, int64_t end) const;
+	string str() const;
+};
+
+// a file read by a command (an annotation) as part of its cache key: its path and identity
+string identity_key(const string &file);
+
+/*
+ on-disk cache of collector states, one file per (input, command, options) in
+ opt.cache_dir; a bam that only grew by appended blocks is resumed from the
+ virtual offset where the last scan stopped
+*/
+class result_cache
+{
+public:
+	result_cache(const options &opt, const string &file, const string &command);
+
+public:
+	int lookup(collector &c, int64_t &voffset);		// 0: miss, 1: up to date, 2: resume from voffset
+	int store(const collector &c, int64_t voffset);
+
+private:
+	options opt;
+	string file;
+	string path;									// the cache entry, empty if disabled
+	file_identity id;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#include "cigar.h"
+#include "util.h"
+
+cigar_key::cigar_key()
+{
+	hash = hash64(NULL, 0);
+}
+
+cigar_key::cigar_key(const uint32_t *cigar, int n)
+{
+	ops.reserve(n);
+	for(int i = 0; i < n; i++)
+	{
+		uint32_t op = bam_cigar_op(cigar[i]);
+		uint32_t len = bam_cigar_oplen(cigar[i]);
+		if(op == BAM_CEQUAL || op == BAM_CDIFF) op = BAM_CMATCH;
+		if(len == 0) continue;
+		if(ops.size() >= 1 && bam_cigar_op(ops.back()) == op) ops.back() += len << BAM_CIGAR_SHIFT;
+		else ops.push_back(bam_cigar_gen(len, op));
+	}
+	hash = hash64(ops.data(), ops.size() * sizeof(uint32_t));
+}
+
+bool cigar_key::operator<(const cigar_key &c) const
+{
+	if(hash != c.hash) return hash < c.hash;
+	return ops < c.ops;
+}
+
+bool cigar_key::operator==(const cigar_key &c) const
+{
+	return hash == c.hash && ops == c.ops;
+}
+
+string cigar_key::str() const
+{
+	return cigar_string(ops.data(), ops.size());
+}
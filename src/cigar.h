@@ -0,0 +1,29 @@
+#ifndef __CIGAR_H__
+#define __CIGAR_H__
+
+#include "hit.h"
+
+using namespace std;
+
+/*
+ a cigar normalized for comparison: =/X are stored as M, adjacent
+ equal operations are merged and empty ones dropped; keys are ordered
+ by a 64-bit hash first, so unequal cigars rarely compare their ops
+*/
+class cigar_key
+{
+public:
+	cigar_key();
+	cigar_key(const uint32_t *cigar, int n);
+
+public:
+	uint64_t hash;
+	vector<uint32_t> ops;
+
+public:
+	bool operator<(const cigar_key &c) const;
+	bool operator==(const cigar_key &c) const;
+	string str() const;					// text form, only for reports
+};
+
+#endif
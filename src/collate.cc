@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "collate.h"
+
+collator::collator(const options &o, samFile *f, bam_hdr_t *h, int n, const string &tag)
+	: opt(o), sfn(f), hdr(h)
+{
+	for(int i = 0; i < n; i++)
+	{
+		buckets.push_back(opt.tmp_dir + "/bamkit." + tostring(getpid()) + "." + tag + "." + tostring(i) + ".bam");
+	}
+}
+
+collator::~collator()
+{
+	for(int i = 0; i < buckets.size(); i++)
+	{
+		unlink(buckets[i].c_str());
+	}
+}
+
+int collator::buckets_for(const options &opt, const string &file)
+{
+	// about four bytes in memory for one compressed byte
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0) return 1;
+	int64_t memory = (int64_t)(opt.memory) << 20;
+	int64_t n = (4 * (int64_t)(st.st_size) + memory - 1) / memory;
+
+	// all buckets are open at once while records are distributed
+	int64_t w = COLLATE_WRITER_BYTES;
+	if(shared_pool(opt) != NULL) w += (int64_t)(opt.threads) * COLLATE_THREAD_BYTES;
+	if(n > memory / w) n = memory / w;
+	if(n > COLLATE_MAX_BUCKETS) n = COLLATE_MAX_BUCKETS;
+	if(n < 1) n = 1;
+	return n;
+}
+
+int collator::run()
+{
+	// temporary files are written with the fastest compression, by the
+	// shared pool when there is one, so a bucket only holds the buffers
+	// of its BGZF block and the blocks queued to the pool (buckets_for)
+	htsThreadPool *p = shared_pool(opt);
+	vector<samFile*> writers;
+	for(int i = 0; i < buckets.size(); i++)
+	{
+		samFile *fout = sam_open(buckets[i].c_str(), "wb1");
+		if(fout == NULL) printf("fail to open %s\n", buckets[i].c_str());
+		if(fout == NULL) exit(0);
+		if(p != NULL) hts_set_thread_pool(fout, p);
+		int f = sam_hdr_write(fout, hdr);
+		if(f < 0) printf("fail to write header to %s\n", buckets[i].c_str());
+		if(f < 0) exit(0);
+		writers.push_back(fout);
+	}
+
+	bam1_t *b1t = bam_init1();
+    while(sam_read1(sfn, hdr, b1t) >= 0)
+	{
+		int i = hash_qname(b1t) % writers.size();
+		int f = sam_write1(writers[i], hdr, b1t);
+		if(f < 0) printf("fail write alignment to %s\n", buckets[i].c_str());
+		if(f < 0) exit(0);
+	}
+	bam_destroy1(b1t);
+
+	for(int i = 0; i < writers.size(); i++)
+	{
+		sam_close(writers[i]);
+	}
+	return 0;
+}
+
+int collator::write(const string &file)
+{
+	samFile *fout = open_output(opt, file);
+
+	int f = sam_hdr_write(fout, hdr);
+	if(f < 0) printf("fail to write header to %s\n", file.c_str());
+	if(f < 0) exit(0);
+
+	vector<bam1_t*> v;
+	for(int i = 0; i < buckets.size(); i++)
+	{
+		samFile *fin = sam_open(buckets[i].c_str(), "r");
+		bam_hdr_t *h = sam_hdr_read(fin);
+
+		int n = 0;
+		while(true)
+		{
+			if(n >= v.size()) v.push_back(bam_init1());
+			if(sam_read1(fin, h, v[n]) < 0) break;
+			n++;
+		}
+		bam_hdr_destroy(h);
+		sam_close(fin);
+
+		sort(v.begin(), v.begin() + n, bam_compare_by_name);
+
+		for(int k = 0; k < n; k++)
+		{
+			f = sam_write1(fout, hdr, v[k]);
+			if(f < 0) printf("fail write alignment to %s\n", file.c_str());
+			if(f < 0) exit(0);
+		}
+	}
+
+	for(int k = 0; k < v.size(); k++) bam_destroy1(v[k]);
+	sam_close(fout);
+	return 0;
+}
+
+uint64_t hash_qname(const bam1_t *b)
+{
+	return hash64(bam_get_qname(b), b->core.l_qname - b->core.l_extranul - 1);
+}
+
+// by the hash of the name only, so mates (and reports) agree in every file and run
+bool sampled_read(const bam1_t *b, double fraction)
+{
+	if(fraction >= 1.0) return true;
+	if(fraction <= 0.0) return false;
+	return hash_qname(b) < (uint64_t)(fraction * 18446744073709551615.0);
+}
+
+bool bam_compare_by_name(const bam1_t *x, const bam1_t *y)
+{
+	int c = strcmp(bam_get_qname(x), bam_get_qname(y));
+	if(c != 0) return (c < 0);
+	// first segment, then second; primary before secondary
+	if((x->core.flag & 0xC0) != (y->core.flag & 0xC0)) return (x->core.flag & 0xC0) < (y->core.flag & 0xC0);
+	return (x->core.flag & 0x900) < (y->core.flag & 0x900);
+}
@@ -0,0 +1,43 @@
+#ifndef __COLLATE_H__
+#define __COLLATE_H__
+
+#include "writer.h"
+
+using namespace std;
+
+#define COLLATE_WRITER_BYTES (1 << 17)		// memory of one bucket being written (BGZF buffers)
+#define COLLATE_THREAD_BYTES (1 << 18)		// and of its blocks queued to each thread of the pool
+#define COLLATE_MAX_BUCKETS 1024			// open files at once
+
+/*
+ groups records by query name without a full sort: records are
+ distributed into temporary bucket files by a hash of the query
+ name, and each bucket is small enough to be grouped in memory;
+ the buckets are removed by the destructor, so they are left in
+ tmp_dir when an I/O error exits the program
+*/
+class collator
+{
+public:
+	collator(const options &opt, samFile *sfn, bam_hdr_t *hdr, int n, const string &tag);
+	~collator();
+
+public:
+	vector<string> buckets;					// temporary bam files, removed by the destructor
+
+public:
+	int run();								// distribute the rest of sfn into the buckets
+	int write(const string &file);			// write all buckets, each grouped by name, to file
+	static int buckets_for(const options &opt, const string &file);
+
+private:
+	options opt;
+	samFile *sfn;
+	bam_hdr_t *hdr;
+};
+
+uint64_t hash_qname(const bam1_t *b);
+bool sampled_read(const bam1_t *b, double fraction);	// whether the read is in the subsample of this fraction of names
+bool bam_compare_by_name(const bam1_t *x, const bam1_t *y);
+
+#endif
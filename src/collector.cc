@@ -0,0 +1,414 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "collector.h"
+#include "genecount.h"
+
+collector::collector(const options &o)
+	: opt(o)
+{
+}
+
+collector::~collector()
+{
+}
+
+bool collector::done() const
+{
+	return false;
+}
+
+bool collector::unmapped() const
+{
+	return false;
+}
+
+int collector::save(ostream &os) const
+{
+	return -1;
+}
+
+int collector::load(istream &is)
+{
+	return -1;
+}
+
+collector *collector::spawn() const
+{
+	return NULL;
+}
+
+int collector::merge(const collector &c)
+{
+	return -1;
+}
+
+count_collector::count_collector(const options &o, bool u)
+	: collector(o), unspliced(u)
+{
+	qcnt = 0;
+	qlen = 0;
+	ivec.assign(500, 0);
+	nhvec.assign(NH_BUCKETS, 0);
+	min_mapping_quality = opt.min_mapping_quality;
+	second_mask = opt.use_second_alignment ? 0 : 0x100;
+}
+
+int count_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x4) >= 1) return probe.skip(SKIP_UNMAPPED);				// read is not mapped
+	if((p.flag & 0x900) == 0) nhvec[nh_bucket(aux_integer(bam_aux_get(b, "NH"), -1))]++;	// once per read, before the filters
+	if((p.flag & second_mask) >= 1) return probe.skip(SKIP_SECONDARY);		// secondary alignment
+	if(p.n_cigar > MAX_NUM_CIGAR) return probe.skip(SKIP_CIGAR);			// ignore hits with more than 7 cigar types
+	if(p.qual < min_mapping_quality) return probe.skip(SKIP_MAPQ);			// ignore hits with small quality
+	if(p.n_cigar < 1) return probe.skip(SKIP_CIGAR);						// should never happen
+	if(unspliced == true && p.n_cigar != 1) return probe.skip(SKIP_SPLICED);
+
+	hit ht(b, 1);
+
+	qlen += ht.qlen;
+	qcnt += 1;
+
+	if(ht.isize <= 0 || ht.isize >= ivec.size()) return 0;
+
+	ivec[ht.isize]++;
+	return 0;
+}
+
+int count_collector::insert_size(double &iave, double &idev) const
+{
+	int64_t icnt = 0;
+	iave = 0;
+	idev = 0;
+	for(int i = 1; i < ivec.size(); i++)
+	{
+		icnt += ivec[i];
+		iave += ivec[i] * i;
+	}
+	if(icnt <= 0) return 0;
+	iave = iave / icnt;
+
+	for(int i = 1; i < ivec.size(); i++)
+	{
+		idev += (i - iave) * (i - iave) * ivec[i];
+	}
+	idev = sqrt(idev / icnt);
+	return 0;
+}
+
+int count_collector::scale(double s)
+{
+	qcnt = llround(qcnt * s);
+	qlen = qlen * s;
+	for(int i = 0; i < ivec.size(); i++) ivec[i] = llround(ivec[i] * s);
+	for(int i = 0; i < nhvec.size(); i++) nhvec[i] = llround(nhvec[i] * s);
+	for(int i = 0; i < SKIP_REASONS; i++) probe.skips[i] = llround(probe.skips[i] * s);
+	return 0;
+}
+
+double count_collector::multi_mapping_rate() const
+{
+	int64_t u = nhvec[1];
+	int64_t m = nhvec[2] + nhvec[3] + nhvec[4];
+	if(u + m <= 0) return 0;
+	return 1.0 * m / (u + m);
+}
+
+int count_collector::print() const
+{
+	double iave, idev;
+	insert_size(iave, idev);
+	printf("aligned reads = %ld aligned base pair = %.0lf average read length = %.2lf insert size = %.2lf +- %.2lf\n", qcnt, qlen, (qcnt > 0 ? qlen / qcnt : 0), iave, idev);
+	printf("NH unique = %ld 2-5 = %ld 6-20 = %ld >20 = %ld no NH = %ld multi-mapping rate = %.4lf\n",
+			nhvec[1], nhvec[2], nhvec[3], nhvec[4], nhvec[0], multi_mapping_rate());
+	probe.print();
+	return 0;
+}
+
+string count_collector::json() const
+{
+	double iave, idev;
+	insert_size(iave, idev);
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"aligned_reads\":%ld,\"aligned_base_pair\":%.0lf,\"average_read_length\":%.2lf,\"insert_size\":%.2lf,\"insert_size_dev\":%.2lf,"
+			"\"nh_unique\":%ld,\"nh_2_5\":%ld,\"nh_6_20\":%ld,\"nh_over_20\":%ld,\"nh_missing\":%ld,\"multi_mapping_rate\":%.4lf,\"skipped\":%s}",
+			qcnt, qlen, (qcnt > 0 ? qlen / qcnt : 0), iave, idev, nhvec[1], nhvec[2], nhvec[3], nhvec[4], nhvec[0], multi_mapping_rate(), probe.json().c_str());
+	return string(buf);
+}
+
+int count_collector::save(ostream &os) const
+{
+	os.precision(17);
+	os << unspliced << " " << qcnt << " " << qlen << " " << ivec.size() << "\n";
+	for(int i = 0; i < ivec.size(); i++)
+	{
+		os << ivec[i] << (i + 1 == ivec.size() ? "\n" : " ");
+	}
+	for(int i = 0; i < nhvec.size(); i++)
+	{
+		os << nhvec[i] << (i + 1 == nhvec.size() ? "\n" : " ");
+	}
+	probe.save(os);
+	return os.good() ? 0 : -1;
+}
+
+int count_collector::load(istream &is)
+{
+	bool u;
+	size_t n;
+	if(!(is >> u >> qcnt >> qlen >> n)) return -1;
+	if(u != unspliced) return -1;
+	ivec.assign(n, 0);
+	for(int i = 0; i < n; i++)
+	{
+		if(!(is >> ivec[i])) return -1;
+	}
+	for(int i = 0; i < nhvec.size(); i++)
+	{
+		if(!(is >> nhvec[i])) return -1;
+	}
+	return probe.load(is);
+}
+
+collector *count_collector::spawn() const
+{
+	return new count_collector(opt, unspliced);
+}
+
+int count_collector::merge(const collector &c)
+{
+	const count_collector &x = dynamic_cast<const count_collector&>(c);
+	qcnt += x.qcnt;
+	qlen += x.qlen;
+	for(int i = 0; i < ivec.size() && i < x.ivec.size(); i++) ivec[i] += x.ivec[i];
+	for(int i = 0; i < nhvec.size() && i < x.nhvec.size(); i++) nhvec[i] += x.nhvec[i];
+	return 0;
+}
+
+strand_collector::strand_collector(const options &o, int _n, shared_ptr<const gene_index> g)
+	: collector(o), n(_n), genes(g)
+{
+	cnt = 0;
+	first = 0;
+	second = 0;
+	ambiguous = 0;
+}
+
+int strand_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if(genes != NULL)
+	{
+		if((p.flag & 0x4) >= 1) return probe.skip(SKIP_UNMAPPED);
+		if((p.flag & 0x100) >= 1) return probe.skip(SKIP_SECONDARY);
+		if((p.flag & 0x800) >= 1) return probe.skip(SKIP_SUPPLEMENTARY);
+		if(p.n_cigar > MAX_NUM_CIGAR) return probe.skip(SKIP_CIGAR);
+		if(p.n_cigar < 1) return probe.skip(SKIP_CIGAR);
+		if(p.qual < opt.min_mapping_quality) return probe.skip(SKIP_MAPQ);
+
+		hit ht(b, 5);
+		char s = genes->strand(ht, hits);
+		if(s == '.' && hits.size() >= 1) ambiguous++;
+		if(s == '.') return probe.skip(SKIP_NO_GENE);
+
+		// strand of the read as RSeQC takes it: that of read 1 (or a single read), flipped for read 2
+		char r = ((p.flag & 0x10) >= 1) ? '-' : '+';
+		if((p.flag & 0x80) >= 1) r = (r == '+') ? '-' : '+';
+
+		// first-strand libraries put read 1 on the opposite strand of the gene
+		if(r != s) first++;
+		else second++;
+		cnt++;
+		if(sampled != NULL) (*sampled)++;
+		return 0;
+	}
+
+	if((p.flag & 0x4) >= 1) return probe.skip(SKIP_UNMAPPED);			// read is not mapped
+	if((p.flag & 0x8) >= 1) return probe.skip(SKIP_MATE_UNMAPPED);		// mate is note mapped
+	if((p.flag & 0x100) >= 1) return probe.skip(SKIP_SECONDARY);		// secondary alignment
+	if(p.n_cigar > MAX_NUM_CIGAR) return probe.skip(SKIP_CIGAR);
+
+	hit ht(b, 3, library<FR_FIRST>());
+	if(ht.xs == '.') return probe.skip(SKIP_NO_XS);
+
+	if(ht.strand == '+' && ht.xs == '+') first++;
+	if(ht.strand == '-' && ht.xs == '-') first++;
+	if(ht.strand == '+' && ht.xs == '-') second++;
+	if(ht.strand == '-' && ht.xs == '+') second++;
+
+	cnt++;
+	if(sampled != NULL) (*sampled)++;
+	return 0;
+}
+
+bool strand_collector::done() const
+{
+	if(cnt >= n) return true;
+	if(sampled != NULL && *sampled >= n) return true;
+	if(genes == NULL) return false;
+	return decided();
+}
+
+bool strand_collector::decided() const
+{
+	if(cnt < STRAND_MIN_SAMPLES) return false;
+
+	double l1, h1, l2, h2;
+	wilson_interval(first, cnt, STRAND_Z, l1, h1);
+	wilson_interval(second, cnt, STRAND_Z, l2, h2);
+	if(l1 >= STRAND_FRACTION || l2 >= STRAND_FRACTION) return true;
+	if(h1 < STRAND_FRACTION && h2 < STRAND_FRACTION) return true;
+	return false;
+}
+
+int wilson_interval(int64_t x, int64_t n, double z, double &low, double &high)
+{
+	low = 0;
+	high = 1;
+	if(n <= 0) return 0;
+
+	double p = 1.0 * x / n;
+	double d = 1 + z * z / n;
+	double c = (p + z * z / (2.0 * n)) / d;
+	double h = z * sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / d;
+	low = max(0.0, c - h);
+	high = min(1.0, c + h);
+	return 0;
+}
+
+string strand_collector::type() const
+{
+	string type = "unstranded";
+	if(genes != NULL)
+	{
+		// early stops agree with the point estimate
+		if(cnt >= STRAND_MIN_SAMPLES && first >= STRAND_FRACTION * cnt) type = "first";
+		if(cnt >= STRAND_MIN_SAMPLES && second >= STRAND_FRACTION * cnt) type = "second";
+		return type;
+	}
+	if(cnt >= 0.8 * n && first >= 0.8 * cnt) type = "first";
+	if(cnt >= 0.8 * n && second >= 0.8 * cnt) type = "second";
+	return type;
+}
+
+int strand_collector::print() const
+{
+	if(genes == NULL) printf("samples = %d, first = %d, second = %d, library = %s\n", cnt, first, second, type().c_str());
+	if(genes == NULL) probe.print();
+	if(genes == NULL) return 0;
+
+	double l, h;
+	wilson_interval(max(first, second), cnt, STRAND_Z, l, h);
+	printf("samples = %d, first = %d, second = %d, ambiguous = %d, agreeing = %.4lf [%.4lf, %.4lf], library = %s\n",
+			cnt, first, second, ambiguous, cnt > 0 ? 1.0 * max(first, second) / cnt : 0, l, h, type().c_str());
+	probe.print();
+	return 0;
+}
+
+string strand_collector::json() const
+{
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"samples\":%d,\"first\":%d,\"second\":%d,\"ambiguous\":%d,\"library\":\"%s\",\"skipped\":%s}", cnt, first, second, ambiguous, type().c_str(), probe.json().c_str());
+	return string(buf);
+}
+
+int strand_collector::save(ostream &os) const
+{
+	os << n << " " << cnt << " " << first << " " << second << " " << ambiguous << "\n";
+	probe.save(os);
+	return os.good() ? 0 : -1;
+}
+
+int strand_collector::load(istream &is)
+{
+	if(!(is >> n >> cnt >> first >> second >> ambiguous)) return -1;
+	return probe.load(is);
+}
+
+collector *strand_collector::spawn() const
+{
+	if(sampled == NULL) sampled = make_shared< atomic<int64_t> >(0);
+	strand_collector *c = new strand_collector(opt, n, genes);
+	c->sampled = sampled;
+	return c;
+}
+
+int strand_collector::merge(const collector &c)
+{
+	const strand_collector &x = dynamic_cast<const strand_collector&>(c);
+	cnt += x.cnt;
+	first += x.first;
+	second += x.second;
+	ambiguous += x.ambiguous;
+	return 0;
+}
+
+junction_collector::junction_collector(const options &o, const bam_hdr_t *h)
+	: collector(o), hdr(h)
+{
+	min_mapping_quality = opt.min_mapping_quality;
+	second_mask = opt.use_second_alignment ? 0 : 0x100;
+}
+
+int junction_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x4) >= 1) return 0;
+	if((p.flag & second_mask) >= 1) return 0;
+	if(p.n_cigar > MAX_NUM_CIGAR) return 0;
+	if(p.n_cigar < 3) return 0;								// no junction
+	if(p.qual < min_mapping_quality) return 0;
+
+	hit ht(b, 5);
+	ht.build_splice_positions(opt);
+
+	for(int i = 0; i < ht.spos.size(); i++)
+	{
+		junctions[make_pair(ht.tid, ht.spos[i])]++;
+	}
+	return 0;
+}
+
+int junction_collector::print() const
+{
+	for(map<pair<int32_t, int64_t>, int>::const_iterator it = junctions.begin(); it != junctions.end(); it++)
+	{
+		int32_t tid = it->first.first;
+		int64_t s = it->first.second;
+		const char *chr = (hdr != NULL && tid >= 0 && tid < hdr->n_targets) ? hdr->target_name[tid] : "*";
+		printf("%s\t%d\t%d\t%d\n", chr, high32(s), low32(s), it->second);
+	}
+	return 0;
+}
+
+string junction_collector::json() const
+{
+	int64_t reads = 0;
+	for(map<pair<int32_t, int64_t>, int>::const_iterator it = junctions.begin(); it != junctions.end(); it++)
+	{
+		reads += it->second;
+	}
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"junctions\":%lu,\"spliced_reads\":%ld}", junctions.size(), reads);
+	return string(buf);
+}
+
+collector *junction_collector::spawn() const
+{
+	return new junction_collector(opt, hdr);
+}
+
+int junction_collector::merge(const collector &c)
+{
+	const junction_collector &x = dynamic_cast<const junction_collector&>(c);
+	for(map<pair<int32_t, int64_t>, int>::const_iterator it = x.junctions.begin(); it != x.junctions.end(); it++)
+	{
+		junctions[it->first] += it->second;
+	}
+	return 0;
+}
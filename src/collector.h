@@ -0,0 +1,153 @@
+#ifndef __COLLECTOR_H__
+#define __COLLECTOR_H__
+
+#include "hit.h"
+#include "probe.h"
+#include <map>
+#include <string>
+#include <memory>
+#include <atomic>
+
+using namespace std;
+
+/*
+ statistics over a stream of alignments; records are fed one at a
+ time through add(), so callers can use their own samFile / bam1_t
+*/
+class collector
+{
+public:
+	collector(const options &opt);
+	virtual ~collector();
+
+public:
+	virtual int add(bam1_t *b) = 0;			// process one record
+	virtual bool done() const;				// whether no more records are needed
+	virtual bool unmapped() const;			// whether unmapped records are used
+	virtual int print() const = 0;			// write the summary to stdout
+	virtual string json() const = 0;		// the summary as a JSON object
+	virtual int save(ostream &os) const;	// serialize the state, -1 if unsupported
+	virtual int load(istream &is);			// restore a state written by save
+	virtual collector *spawn() const;		// an empty one with the same settings, NULL if order matters
+	virtual int merge(const collector &c);	// add the state of a spawned one, -1 if unsupported
+
+public:
+	filter_probe probe;						// skipped records by reason, merged by engine
+
+protected:
+	options opt;
+};
+
+#define NH_BUCKETS 5
+
+// bucket of an NH value: 0 for a missing tag, then 1, 2-5, 6-20 and >20
+inline int nh_bucket(int64_t nh)
+{
+	if(nh < 1) return 0;
+	if(nh == 1) return 1;
+	if(nh <= 5) return 2;
+	if(nh <= 20) return 3;
+	return 4;
+}
+
+// aligned reads, base pairs, insert sizes and NH buckets
+class count_collector: public collector
+{
+public:
+	count_collector(const options &opt, bool unspliced);
+
+public:
+	bool unspliced;						// only take reads with a single cigar operation
+	int64_t qcnt;						// aligned reads
+	double qlen;						// aligned base pairs
+	vector<int64_t> ivec;				// histogram of insert sizes
+	vector<int64_t> nhvec;				// primary alignments by NH: none, 1, 2-5, 6-20, >20
+
+public:
+	int add(bam1_t *b);
+	int print() const;
+	string json() const;
+	int save(ostream &os) const;
+	int load(istream &is);
+	collector *spawn() const;
+	int merge(const collector &c);
+	int insert_size(double &ave, double &dev) const;
+	double multi_mapping_rate() const;
+	int scale(double s);				// extrapolate the counts of a sample
+
+private:
+	uint32_t min_mapping_quality;
+	uint16_t second_mask;
+};
+
+// agreement of XS with the first/second-strand orientation
+class gene_index;
+
+#define STRAND_MIN_SAMPLES 200			// samples before an annotated inference may stop
+#define STRAND_FRACTION 0.8				// agreeing fraction of a stranded library
+#define STRAND_Z 3.29					// z of the confidence to stop (99.9%)
+
+/*
+ library type from the XS tag of spliced reads or, given genes, from
+ the strand of the genes overlapped by any read (as RSeQC does); the
+ latter stops as soon as the Wilson interval of the agreeing fraction
+ is entirely above or below STRAND_FRACTION
+*/
+class strand_collector: public collector
+{
+public:
+	strand_collector(const options &opt, int n, shared_ptr<const gene_index> genes = shared_ptr<const gene_index>());
+
+public:
+	int n;								// number of samples required
+	int cnt;							// sampled reads with XS (or a single-strand gene)
+	int first;							// reads agreeing with FR_FIRST
+	int second;							// reads agreeing with FR_SECOND
+	int ambiguous;						// reads overlapping genes on both strands
+	shared_ptr<const gene_index> genes;	// NULL to use XS
+
+public:
+	int add(bam1_t *b);
+	bool done() const;
+	int print() const;
+	string json() const;
+	int save(ostream &os) const;
+	int load(istream &is);
+	collector *spawn() const;
+	int merge(const collector &c);
+	string type() const;
+
+private:
+	vector<int32_t> hits;
+	mutable shared_ptr< atomic<int64_t> > sampled;	// samples of all collectors spawned from one, so n bounds their sum
+
+private:
+	bool decided() const;
+};
+
+// Wilson score interval of x successes in n trials
+int wilson_interval(int64_t x, int64_t n, double z, double &low, double &high);
+
+// splice junctions and their number of supporting reads
+class junction_collector: public collector
+{
+public:
+	junction_collector(const options &opt, const bam_hdr_t *hdr);
+
+public:
+	const bam_hdr_t *hdr;
+	map<pair<int32_t, int64_t>, int> junctions;	// (tid, pack(start, end)) -> count
+
+public:
+	int add(bam1_t *b);
+	int print() const;
+	string json() const;
+	collector *spawn() const;
+	int merge(const collector &c);
+
+private:
+	uint32_t min_mapping_quality;
+	uint16_t second_mask;
+};
+
+#endif
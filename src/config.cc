@@ -6,6 +6,7 @@ See LICENSE for licensing.
 
 #include "config.h"
 #include <cstdlib>
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -14,337 +15,286 @@ See LICENSE for licensing.
 
 using namespace std;
 
-//// parameters
-// for bam file and reads
-int min_flank_length = 3;
-int max_edit_distance = 10;
-int32_t min_bundle_gap = 50;
-int min_num_hits_in_bundle = 20;
-uint32_t min_mapping_quality = 1;
-int32_t min_splice_boundary_hits = 1;
-bool use_second_alignment = false;
-bool uniquely_mapped_only = false;
-int library_type = UNSTRANDED;
-
-// for identifying subgraphs
-int32_t min_subregion_gap = 3;
-double min_subregion_overlap = 1.5;
-int32_t min_subregion_length = 15;
-
-// for revising/decomposing splice graph
-double max_intron_contamination_coverage = 2.0;
-double min_surviving_edge_weight = 1.5;
-double max_decompose_error_ratio[7] = {0.33, 0.05, 0.0, 0.25, 0.30, 0.0, 1.1};
-
-// for selecting paths
-double min_transcript_coverage = 1.01;
-double min_transcript_coverage_ratio = 0.005;
-double min_single_exon_coverage = 20;
-double min_transcript_numreads = 20;
-int min_transcript_length_base = 150;
-int min_transcript_length_increase = 50;
-int min_exon_length = 20;
-int max_num_exons = 1000;
-
-// for subsetsum and router
-int max_dp_table_size = 10000;
-int min_router_count = 1;
-
-// for simulation
-int simulation_num_vertices = 0;
-int simulation_num_edges = 0;
-int simulation_max_edge_weight = 0;
-
-// input and output
-string algo = "scallop";
-string input_file;
-string ref_file;
-string ref_file1;
-string ref_file2;
-string output_file;
+options::options()
+{
+	// for bam file and reads
+	min_flank_length = 3;
+	min_mapping_quality = 1;
+	max_edit_distance = -1;
+	use_second_alignment = false;
+	library_type = FR_SECOND;
+	split_by = "end";
+	output_format = "auto";
+	compression_level = -1;
+	reference = "";
+	unordered = false;
+	annotation = "";
+	min_junction_support = 1;
+	junction_action = "drop";
+	sample_timing = false;
+	progress = "none";
+	fraction = 1.0;
+	estimate = false;
 
-// for controling
-bool output_tex_files = false;
-string fixed_gene_name = "";
-int batch_bundle_size = 100;
-int verbose = 1;
-string version = "v0.9.9";
+	// for controling
+	threads = 4;
+	socket = "";
+	cache_dir = "";
+	tmp_dir = ".";
+	memory = 4096;
+	report_records = 0;
+	report_seconds = 0;
+	report_dir = "";
+	report_sample = 1.0;
+	report_compress = false;
+	verbose = 1;
+	version = "v1.0";
+}
 
-int parse_arguments(int argc, const char ** argv)
+int options::parse_arguments(int argc, const char ** argv)
 {
 	for(int i = 1; i < argc; i++)
 	{
-		// necessary ones
-		if(string(argv[i]) == "-i")
+		string s(argv[i]);
+		bool more = (i + 1 < argc);
+
+		if(s == "--version")
 		{
-			input_file = string(argv[i + 1]);
-			i++;
+			printf("%s\n", version.c_str());
+			exit(0);
 		}
-		else if(string(argv[i]) == "-o")
+		else if(s == "--help")
 		{
-			output_file = string(argv[i + 1]);
-			i++;
+			print_copyright();
+			print_help();
+			exit(0);
 		}
-
-		// internal use
-		else if(string(argv[i]) == "-a")
+		else if(s == "--min_flank_length" && more)
 		{
-			algo = string(argv[i + 1]);
+			min_flank_length = atoi(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "-r")
+		else if(s == "--min_mapping_quality" && more)
 		{
-			ref_file = string(argv[i + 1]);
+			min_mapping_quality = atoi(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "-r1")
+		else if(s == "--max_edit_distance" && more)
 		{
-			ref_file1 = string(argv[i + 1]);
+			max_edit_distance = atoi(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "-r2")
+		else if(s == "--library_type" && more)
 		{
-			ref_file2 = string(argv[i + 1]);
+			string t(argv[i + 1]);
+			if(t == "unstranded") library_type = UNSTRANDED;
+			else if(t == "first") library_type = FR_FIRST;
+			else if(t == "second") library_type = FR_SECOND;
+			else
+			{
+				printf("Error: unknown library type %s\n", t.c_str());
+				exit(0);
+			}
 			i++;
 		}
-		else if(string(argv[i]) == "-g")
+		else if(s == "--output_format" && more)
 		{
-			fixed_gene_name = string(argv[i + 1]);
+			output_format = string(argv[i + 1]);
+			if(output_format != "auto" && output_format != "bam" && output_format != "cram" && output_format != "sam")
+			{
+				printf("Error: unknown output format %s\n", output_format.c_str());
+				exit(0);
+			}
 			i++;
 		}
-		else if(string(argv[i]) == "-t")
-		{
-			output_tex_files = true;
-		}
-
-		// user specified
-		else if(string(argv[i]) == "--version")
-		{
-			printf("%s\n", version.c_str());
-			exit(0);
-		}
-		else if(string(argv[i]) == "--help")
+		else if(s == "--compression_level" && more)
 		{
-			print_copyright();
-			print_help();
-			printf("\n");
-			print_logo();
-			exit(0);
-		}
-		else if(string(argv[i]) == "--min_flank_length")
-		{
-			min_flank_length = atoi(argv[i + 1]);
+			compression_level = atoi(argv[i + 1]);
+			if(compression_level > 9) compression_level = 9;
 			i++;
 		}
-		else if(string(argv[i]) == "--max_edit_distance")
+		else if(s == "--reference" && more)
 		{
-			max_edit_distance = atoi(argv[i + 1]);
+			reference = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_bundle_gap")
+		else if(s == "--unordered" && more)
 		{
-			min_bundle_gap = atoi(argv[i + 1]);
+			string t(argv[i + 1]);
+			if(t == "true") unordered = true;
+			else unordered = false;
 			i++;
 		}
-		else if(string(argv[i]) == "--min_num_hits_in_bundle")
+		else if(s == "--annotation" && more)
 		{
-			min_num_hits_in_bundle = atoi(argv[i + 1]);
+			annotation = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_mapping_quality")
+		else if(s == "--min_junction_support" && more)
 		{
-			min_mapping_quality = atoi(argv[i + 1]);
+			min_junction_support = atoi(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_splice_boundary_hits")
+		else if(s == "--junction_action" && more)
 		{
-			min_splice_boundary_hits = atoi(argv[i + 1]);
+			junction_action = string(argv[i + 1]);
+			if(junction_action != "flag") junction_action = "drop";
 			i++;
 		}
-		else if(string(argv[i]) == "--min_subregion_gap")
+		else if(s == "--sample_timing" && more)
 		{
-			min_subregion_gap = atoi(argv[i + 1]);
+			string t(argv[i + 1]);
+			if(t == "true") sample_timing = true;
+			else sample_timing = false;
 			i++;
 		}
-		else if(string(argv[i]) == "--min_subregion_length")
+		else if(s == "--progress" && more)
 		{
-			min_subregion_length = atoi(argv[i + 1]);
+			progress = string(argv[i + 1]);
+			if(progress != "text" && progress != "json") progress = "none";
 			i++;
 		}
-		else if(string(argv[i]) == "--min_subregion_overlap")
+		else if(s == "--fraction" && more)
 		{
-			min_subregion_overlap = atof(argv[i + 1]);
+			fraction = atof(argv[i + 1]);
+			if(fraction <= 0 || fraction > 1)
+			{
+				printf("Error: --fraction %s is not in (0, 1]\n", argv[i + 1]);
+				exit(0);
+			}
 			i++;
 		}
-		else if(string(argv[i]) == "--min_surviving_edge_weight")
+		else if(s == "--estimate" && more)
 		{
-			min_surviving_edge_weight = atof(argv[i + 1]);
+			string t(argv[i + 1]);
+			if(t == "true") estimate = true;
+			else estimate = false;
 			i++;
 		}
-		else if(string(argv[i]) == "--max_intron_contamination_coverage")
+		else if(s == "--by" && more)
 		{
-			max_intron_contamination_coverage = atof(argv[i + 1]);
+			split_by = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_transcript_coverage")
+		else if(s == "--use_second_alignment" && more)
 		{
-			min_transcript_coverage = atof(argv[i + 1]);
+			string t(argv[i + 1]);
+			if(t == "true") use_second_alignment = true;
+			else use_second_alignment = false;
 			i++;
-			if(fabs(min_transcript_coverage - 1.0) < 0.01) min_transcript_coverage = 1.01;
 		}
-		else if(string(argv[i]) == "--min_transcript_coverage_ratio")
+		else if(s == "--threads" && more)
 		{
-			min_transcript_coverage_ratio = atof(argv[i + 1]);
+			threads = atoi(argv[i + 1]);
+			if(threads < 1) threads = 1;
 			i++;
 		}
-		else if(string(argv[i]) == "--min_single_exon_coverage")
+		else if(s == "--socket" && more)
 		{
-			min_single_exon_coverage = atof(argv[i + 1]);
+			socket = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_transcript_numreads")
+		else if(s == "--cache_dir" && more)
 		{
-			min_transcript_numreads = atof(argv[i + 1]);
+			cache_dir = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_transcript_length_base")
+		else if(s == "--tmp_dir" && more)
 		{
-			min_transcript_length_base = atoi(argv[i + 1]);
+			tmp_dir = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_transcript_length_increase")
+		else if(s == "--memory" && more)
 		{
-			min_transcript_length_increase = atoi(argv[i + 1]);
+			memory = atoi(argv[i + 1]);
+			if(memory < 16) memory = 16;
 			i++;
 		}
-		else if(string(argv[i]) == "--min_exon_length")
+		else if(s == "--report_records" && more)
 		{
-			min_exon_length = atoi(argv[i + 1]);
+			report_records = atol(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--max_num_exons")
+		else if(s == "--report_seconds" && more)
 		{
-			max_num_exons = atoi(argv[i + 1]);
+			report_seconds = atof(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--max_dp_table_size")
+		else if(s == "--report_dir" && more)
 		{
-			max_dp_table_size = atoi(argv[i + 1]);
+			report_dir = string(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--min_router_count")
+		else if(s == "--report_sample" && more)
 		{
-			min_router_count = atoi(argv[i + 1]);
+			report_sample = atof(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--library_type")
+		else if(s == "--report_compress" && more)
 		{
-			string s(argv[i + 1]);
-			if(s == "unstranded") library_type = UNSTRANDED;
-			if(s == "first") library_type = FR_FIRST;
-			if(s == "second") library_type = FR_SECOND;
+			string t(argv[i + 1]);
+			if(t == "true") report_compress = true;
+			else report_compress = false;
 			i++;
 		}
-		else if(string(argv[i]) == "--use_second_alignment")
+		else if(s == "--verbose" && more)
 		{
-			string s(argv[i + 1]);
-			if(s == "true") use_second_alignment = true;
-			else use_second_alignment = false;
+			verbose = atoi(argv[i + 1]);
 			i++;
 		}
-		else if(string(argv[i]) == "--uniquely_mapped_only")
+		else if(s.size() >= 2 && s.substr(0, 2) == "--")
 		{
-			string s(argv[i + 1]);
-			if(s == "true") uniquely_mapped_only = true;
-			else uniquely_mapped_only = false;
-			i++;
+			printf("Error: unknown or incomplete option %s\n", s.c_str());
+			exit(0);
 		}
-		else if(string(argv[i]) == "--verbose")
+		else if(command == "")
 		{
-			verbose = atoi(argv[i + 1]);
-			i++;
+			command = s;
 		}
-		else if(string(argv[i]) == "--batch_bundle_size")
+		else
 		{
-			batch_bundle_size = atoi(argv[i + 1]);
-			i++;
+			args.push_back(s);
 		}
 	}
 
-	if(min_surviving_edge_weight < 0.1 + min_transcript_coverage) 
-	{
-		min_surviving_edge_weight = 0.1 + min_transcript_coverage;
-	}
-
-	// verify arguments
-	if(input_file == "")
-	{
-		printf("Error: input-file is missing.\n");
-		exit(0);
-	}
-
-	if(output_file == "")
-	{
-		printf("Error: output-file is missing.\n");
-		exit(0);
-	}
-
 	return 0;
 }
 
-int print_parameters()
+int options::print_parameters() const
 {
 	printf("parameters:\n");
 
 	// for bam file and reads
 	printf("min_flank_length = %d\n", min_flank_length);
-	printf("max_edit_distance = %d\n", max_edit_distance);
-	printf("min_bundle_gap = %d\n", min_bundle_gap);
-	printf("min_num_hits_in_bundle = %d\n", min_num_hits_in_bundle);
 	printf("min_mapping_quality = %d\n", min_mapping_quality);
-	printf("min_splice_boundary_hits = %d\n", min_splice_boundary_hits);
-
-	// for identifying subgraphs
-	printf("min_subregion_gap = %d\n", min_subregion_gap);
-	printf("min_subregion_length = %d\n", min_subregion_length);
-	printf("min_subregion_overlap = %.2lf\n", min_subregion_overlap);
-
-	// for splice graph
-	printf("max_intron_contamination_coverage = %.2lf\n", max_intron_contamination_coverage);
-	printf("min_surviving_edge_weight = %.2lf\n", min_surviving_edge_weight);
-	printf("min_transcript_coverage = %.2lf\n", min_transcript_coverage);
-	printf("min_transcript_coverage_ratio = %.2lf\n", min_transcript_coverage_ratio);
-	printf("min_single_exon_coverage = %.2lf\n", min_single_exon_coverage);
-	printf("min_transcript_numreads = %.2lf\n", min_transcript_numreads);
-	printf("min_transcript_length_base = %d\n", min_transcript_length_base);
-	printf("min_transcript_length_increase = %d\n", min_transcript_length_increase);
-	printf("max_num_exons = %d\n", max_num_exons);
-
-	// for subsetsum and router
-	printf("max_dp_table_size = %d\n", max_dp_table_size);
-	printf("min_router_count = %d\n", min_router_count);
-
-	// for simulation
-	printf("simulation_num_vertices = %d\n", simulation_num_vertices);
-	printf("simulation_num_edges = %d\n", simulation_num_edges);
-	printf("simulation_max_edge_weight = %d\n", simulation_max_edge_weight);
-
-	// for input and output
-	printf("algo = %s\n", algo.c_str());
-	printf("input_file = %s\n", input_file.c_str());
-	printf("ref_file = %s\n", ref_file.c_str());
-	printf("ref_file1 = %s\n", ref_file1.c_str());
-	printf("ref_file2 = %s\n", ref_file2.c_str());
-	printf("output_file = %s\n", output_file.c_str());
+	printf("max_edit_distance = %d\n", max_edit_distance);
+	printf("use_second_alignment = %c\n", use_second_alignment ? 'T' : 'F');
+	printf("library_type = %d\n", library_type);
+	printf("split_by = %s\n", split_by.c_str());
+	printf("output_format = %s\n", output_format.c_str());
+	printf("compression_level = %d\n", compression_level);
+	printf("reference = %s\n", reference.c_str());
+	printf("unordered = %c\n", unordered ? 'T' : 'F');
+	printf("annotation = %s\n", annotation.c_str());
+	printf("min_junction_support = %d\n", min_junction_support);
+	printf("junction_action = %s\n", junction_action.c_str());
+	printf("sample_timing = %c\n", sample_timing ? 'T' : 'F');
+	printf("progress = %s\n", progress.c_str());
+	printf("fraction = %.4lf\n", fraction);
+	printf("estimate = %c\n", estimate ? 'T' : 'F');
 
 	// for controling
-	printf("library_type = %d\n", library_type);
-	printf("output_tex_files = %c\n", output_tex_files ? 'T' : 'F');
-	printf("fixed_gene_name = %s\n", fixed_gene_name.c_str());
-	printf("use_second_alignment = %c\n", use_second_alignment ? 'T' : 'F');
-	printf("uniquely_mapped_only = %c\n", uniquely_mapped_only ? 'T' : 'F');
+	printf("threads = %d\n", threads);
+	printf("socket = %s\n", socket.c_str());
+	printf("cache_dir = %s\n", cache_dir.c_str());
+	printf("tmp_dir = %s\n", tmp_dir.c_str());
+	printf("memory = %d\n", memory);
+	printf("report_records = %ld\n", report_records);
+	printf("report_seconds = %.2lf\n", report_seconds);
+	printf("report_dir = %s\n", report_dir.c_str());
+	printf("report_sample = %.4lf\n", report_sample);
+	printf("report_compress = %c\n", report_compress ? 'T' : 'F');
 	printf("verbose = %d\n", verbose);
-	printf("batch_bundle_size = %d\n", batch_bundle_size);
 
 	printf("\n");
 
@@ -362,50 +312,72 @@ int print_command_line(int argc, const char ** argv)
 	return 0;
 }
 
-
-int print_logo()
+int options::print_help() const
 {
-	printf("      ___           ___           ___                                       ___           ___    \n");
-	printf("     /  /\\         /  /\\         /  /\\                                     /  /\\         /  /\\   \n");
-	printf("    /  /:/_       /  /:/        /  /::\\                                   /  /::\\       /  /::\\  \n");
-	printf("   /  /:/ /\\     /  /:/        /  /:/\\:\\    ___     ___   ___     ___    /  /:/\\:\\     /  /:/\\:\\ \n");
-	printf("  /  /:/ /::\\   /  /:/  ___   /  /:/~/::\\  /__/\\   /  /\\ /__/\\   /  /\\  /  /:/  \\:\\   /  /:/~/:/ \n");
-	printf(" /__/:/ /:/\\:\\ /__/:/  /  /\\ /__/:/ /:/\\:\\ \\  \\:\\ /  /:/ \\  \\:\\ /  /:/ /__/:/ \\__\\:\\ /__/:/ /:/  \n");
-	printf(" \\  \\:\\/:/~/:/ \\  \\:\\ /  /:/ \\  \\:\\/:/__\\/  \\  \\:\\  /:/   \\  \\:\\  /:/  \\  \\:\\ /  /:/ \\  \\:\\/:/   \n");
-	printf("  \\  \\::/ /:/   \\  \\:\\  /:/   \\  \\::/        \\  \\:\\/:/     \\  \\:\\/:/    \\  \\:\\  /:/   \\  \\::/    \n");
-	printf("   \\__\\/ /:/     \\  \\:\\/:/     \\  \\:\\         \\  \\::/       \\  \\::/      \\  \\:\\/:/     \\  \\:\\    \n");
-	printf("     /__/:/       \\  \\::/       \\  \\:\\         \\__\\/         \\__\\/        \\  \\::/       \\  \\:\\   \n");
-	printf("     \\__\\/         \\__\\/         \\__\\/                                     \\__\\/         \\__\\/   \n");
 	printf("\n");
-
-	return 0;
-}
-
-int print_help()
-{
+	printf("Usage: bamkit <command> <arguments> [options]\n");
 	printf("\n");
-	printf("Usage: scallop -i <bam-file> -o <gtf-file> [options]\n");
+	printf("Commands:\n");
+	printf(" %-42s\n", "count <bam-file>");
+	printf(" %-42s\n", "strand <bam-file>");
+	printf(" %-42s\n", "fragment <bam-file>");
+	printf(" %-42s\n", "junction <bam-file>");
+	printf(" %-42s\n", "stats <bam-file>");
+	printf(" %-42s\n", "pairs <bam-file>");
+	printf(" %-42s\n", "dupstat <bam-file>");
+	printf(" %-42s\n", "basestats <bam-file>");
+	printf(" %-42s\n", "edits <bam-file>");
+	printf(" %-42s\n", "genecount <bam-file> <gtf-file>");
+	printf(" %-42s\n", "ts2XS <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "name2to1 <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "addXS <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "filter2ndAlign <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "splitByEnd <in-bam-file> <out-bam-file1> <out-bam-file2>");
+	printf(" %-42s\n", "splitSinglePaired <in-bam-file> <out-bam-file1> <out-bam-file2>");
+	printf(" %-42s\n", "split <in-bam-file> <out-prefix> --by <criterion>");
+	printf(" %-42s\n", "collate <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "pick-primary <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "filter-junctions <in-bam-file> <out-bam-file>");
+	printf(" %-42s\n", "alignPairEval <aligner-bam> <ground-truth-bam>");
+	printf(" %-42s\n", "bridgeEval <coral-bam> <aligner-bam> <ground-truth-bam> <gtf-file>");
+	printf(" %-42s\n", "serve --socket <path>");
 	printf("\n");
 	printf("Options:\n");
-	printf(" %-42s  %s\n", "--help",  "print usage of Scallop and exit");
-	printf(" %-42s  %s\n", "--version",  "print current version of Scallop and exit");
-	printf(" %-42s  %s\n", "--verbose <0, 1, 2>",  "0: quiet; 1: one line for each graph; 2: with details, default: 1");
-	printf(" %-42s  %s\n", "--library_type <first, second, unstranded>",  "library type of the sample, default: unstranded");
-	printf(" %-42s  %s\n", "--min_transcript_coverage <float>",  "minimum coverage required for a multi-exon transcript, default: 1.01");
-	printf(" %-42s  %s\n", "--min_single_exon_coverage <float>",  "minimum coverage required for a single-exon transcript, default: 20");
-	printf(" %-42s  %s\n", "--min_transcript_length_increase <integer>",  "default: 50");
-	printf(" %-42s  %s\n", "--min_transcript_length_base <integer>",  "default: 250, minimum length of a transcript would be");
-	printf(" %-42s  %s\n", "",  "--min_transcript_length_base + --min_transcript_length_increase * num-of-exons");
+	printf(" %-42s  %s\n", "--help",  "print usage of bamkit and exit");
+	printf(" %-42s  %s\n", "--version",  "print current version of bamkit and exit");
+	printf(" %-42s  %s\n", "--verbose <0, 1, 2>",  "0: quiet; 1: normal; 2: with details, default: 1");
+	printf(" %-42s  %s\n", "--library_type <first, second, unstranded>",  "library type used by addXS, splitByEnd and split, default: second");
+	printf(" %-42s  %s\n", "--threads <integer>",  "number of worker threads, default: 4");
+	printf(" %-42s  %s\n", "--socket <path>",  "unix socket that serve listens on");
+	printf(" %-42s  %s\n", "--cache_dir <directory>",  "keep results of count/fragment/strand here and reuse them, default: none");
+	printf(" %-42s  %s\n", "--tmp_dir <directory>",  "directory of temporary files of collate and evaluation, default: .");
+	printf(" %-42s  %s\n", "--memory <integer>",  "memory budget in MB for collate and evaluation, default: 4096");
+	printf(" %-42s  %s\n", "--report_records <integer>",  "print partial results (JSON, stderr) every so many records, default: 0 (never)");
+	printf(" %-42s  %s\n", "--report_seconds <float>",  "print partial results (JSON, stderr) every so many seconds, default: 0 (never)");
+	printf(" %-42s  %s\n", "--fraction <float>",  "scans only use reads whose name hash falls in this fraction, default: 1.0");
+	printf(" %-42s  %s\n", "--estimate <true, false>",  "count and fragment decode --fraction of the BGZF blocks and extrapolate, default: false");
+	printf(" %-42s  %s\n", "--progress <none, text, json>",  "print progress, rate and ETA of scans to stderr every 10 seconds, default: none");
+	printf(" %-42s  %s\n", "--sample_timing <true, false>",  "time the collectors on one record in 1024 and report ns per record, default: false");
+	printf(" %-42s  %s\n", "--report_dir <directory>",  "write mismatch reports of alignPairEval/bridgeEval here, default: none");
+	printf(" %-42s  %s\n", "--report_sample <float>",  "fraction of reads kept in mismatch reports, default: 1.0");
+	printf(" %-42s  %s\n", "--report_compress <true, false>",  "BGZF-compress mismatch reports (.gz), default: false");
 	printf(" %-42s  %s\n", "--min_mapping_quality <integer>",  "ignore reads with mapping quality less than this value, default: 1");
-	printf(" %-42s  %s\n", "--min_bundle_gap <integer>",  "minimum distances required to start a new bundle, default: 50");
-	printf(" %-42s  %s\n", "--min_num_hits_in_bundle <integer>",  "minimum number of reads required in a bundle, default: 20");
+	printf(" %-42s  %s\n", "--max_edit_distance <integer>",  "filter2ndAlign drops alignments whose NM (or nM) exceeds this value, default: -1 (no limit)");
+	printf(" %-42s  %s\n", "--by <end, pairing, strand, rg, contig, nh>",  "criterion of split, default: end");
+	printf(" %-42s  %s\n", "--output_format <auto, bam, cram, sam>",  "format of written alignments, auto: by extension (.sam, .cram, else bam), default: auto");
+	printf(" %-42s  %s\n", "--compression_level <0-9>",  "compression level of BAM/CRAM output, default: htslib's");
+	printf(" %-42s  %s\n", "--reference <fasta-file>",  "reference (with .fai) for reading and writing CRAM; addXS takes XS from its splice motifs");
+	printf(" %-42s  %s\n", "--unordered <true, false>",  "filter2ndAlign may write records out of input order, using all threads, default: false");
+	printf(" %-42s  %s\n", "--annotation <gtf-file>",  "GTF or .bed genes: strand infers from them, stats also counts reads per gene");
+	printf(" %-42s  %s\n", "--min_junction_support <integer>",  "filter-junctions removes alignments with a junction of fewer reads, default: 1 (none)");
+	printf(" %-42s  %s\n", "--junction_action <drop, flag>",  "filter-junctions drops alignments or flags them as QC failed (0x200), default: drop");
+	printf(" %-42s  %s\n", "--use_second_alignment <true, false>",  "whether count and fragment use secondary alignments, default: false");
 	printf(" %-42s  %s\n", "--min_flank_length <integer>",  "minimum match length in each side for a spliced read, default: 3");
-	printf(" %-42s  %s\n", "--min_splice_bundary_hits <integer>",  "minimum number of spliced reads required for a junction, default: 1");
 	return 0;
 }
 
-int print_copyright()
+int options::print_copyright() const
 {
-	printf("Scallop %s (c) 2017 Mingfu Shao, Carl Kingsford, and Carnegie Mellon University\n", version.c_str());
+	printf("bamkit %s (c) 2017 Mingfu Shao, Carl Kingsford, and Carnegie Mellon University\n", version.c_str());
 	return 0;
 }
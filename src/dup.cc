@@ -0,0 +1,204 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <thread>
+
+#include "dup.h"
+
+dup_collector::dup_collector(const options &o)
+	: collector(o)
+{
+	pairs = 0;
+	singles = 0;
+	unique_pairs = 0;
+	unique_singles = 0;
+	finished = false;
+	parts.resize(2 << DUP_PARTITION_BITS);
+}
+
+int dup_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x4) >= 1) return 0;				// read is not mapped
+	if((p.flag & 0x900) >= 1) return 0;				// secondary or supplementary alignment
+	if(p.n_cigar < 1) return 0;
+
+	bool paired = ((p.flag & 0x1) >= 1 && (p.flag & 0x8) <= 0 && p.mtid == p.tid);
+	if(paired == true && (p.flag & 0x40) <= 0) return 0;		// one record for a fragment
+
+	bool reverse = ((p.flag & 0x10) >= 1);
+	int32_t x = unclipped_5prime(p.pos, reverse, bam_get_cigar(b), p.n_cigar);
+
+	// (tid, type) and the (position, strand) of each end, ordered
+	int64_t key[3];
+	key[0] = pack(p.tid, paired ? 1 : 0);
+	key[1] = pack(x, reverse ? 1 : 0);
+	key[2] = -1;
+
+	if(paired == true)
+	{
+		bool mreverse = ((p.flag & 0x20) >= 1);
+		int32_t y = p.mpos;
+		uint8_t *mc = bam_aux_get(b, "MC");
+		vector<uint32_t> v;
+		if(mc && (*mc) == 'Z' && parse_cigar(bam_aux2Z(mc), v) == 0 && v.size() >= 1)
+		{
+			y = unclipped_5prime(p.mpos, mreverse, v.data(), v.size());
+		}
+		key[2] = pack(y, mreverse ? 1 : 0);
+		if(key[2] < key[1]) swap(key[1], key[2]);
+		pairs++;
+	}
+	else
+	{
+		singles++;
+	}
+
+	uint64_t h = hash64(key, sizeof(key));
+	int k = (h >> (64 - DUP_PARTITION_BITS)) + (paired ? (1 << DUP_PARTITION_BITS) : 0);
+	parts[k].push_back(h);
+	finished = false;
+	return 0;
+}
+
+int64_t dup_collector::count_partition(int k) const
+{
+	const vector<uint64_t> &v = parts[k];
+	size_t m = 16;
+	while(m < 2 * v.size()) m <<= 1;
+	vector<uint64_t> table(m, 0);
+
+	int64_t u = 0;
+	for(int i = 0; i < v.size(); i++)
+	{
+		uint64_t h = (v[i] == 0) ? 1 : v[i];		// 0 marks an empty slot
+		size_t j = h & (m - 1);
+		while(table[j] != 0 && table[j] != h) j = (j + 1) & (m - 1);
+		if(table[j] == h) continue;
+		table[j] = h;
+		u++;
+	}
+	return u;
+}
+
+int dup_collector::finish()
+{
+	if(finished == true) return 0;
+
+	vector<int64_t> u(parts.size(), 0);
+	vector<thread> workers;
+	int t = opt.threads;
+	for(int w = 0; w < t; w++)
+	{
+		workers.push_back(thread([this, w, t, &u]()
+		{
+			for(int k = w; k < parts.size(); k += t) u[k] = count_partition(k);
+		}));
+	}
+	for(int w = 0; w < workers.size(); w++) workers[w].join();
+
+	int n = 1 << DUP_PARTITION_BITS;
+	unique_singles = 0;
+	unique_pairs = 0;
+	for(int k = 0; k < n; k++) unique_singles += u[k];
+	for(int k = n; k < 2 * n; k++) unique_pairs += u[k];
+	finished = true;
+	return 0;
+}
+
+double dup_collector::duplicate_rate() const
+{
+	int64_t n = pairs + singles;
+	if(n == 0) return 0;
+	return 1.0 - 1.0 * (unique_pairs + unique_singles) / n;
+}
+
+double dup_collector::library_size() const
+{
+	// from pairs as Picard does, or from single ends for single-end data
+	if(pairs >= 1) return estimate_library_size(pairs, unique_pairs);
+	return estimate_library_size(singles, unique_singles);
+}
+
+int dup_collector::print() const
+{
+	printf("fragments = %ld (pairs = %ld, singles = %ld) unique = %ld duplicate rate = %.4lf estimated library size = %.0lf\n",
+			pairs + singles, pairs, singles, unique_pairs + unique_singles, duplicate_rate(), library_size());
+	return 0;
+}
+
+string dup_collector::json() const
+{
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"pairs\":%ld,\"singles\":%ld,\"unique_pairs\":%ld,\"unique_singles\":%ld,\"duplicate_rate\":%.4lf,\"library_size\":%.0lf}",
+			pairs, singles, unique_pairs, unique_singles, duplicate_rate(), library_size());
+	return string(buf);
+}
+
+int32_t unclipped_5prime(int32_t pos, bool reverse, const uint32_t *cigar, int n)
+{
+	if(reverse == false)
+	{
+		int32_t x = pos;
+		for(int k = 0; k < n; k++)
+		{
+			int op = bam_cigar_op(cigar[k]);
+			if(op != BAM_CSOFT_CLIP && op != BAM_CHARD_CLIP) break;
+			x -= bam_cigar_oplen(cigar[k]);
+		}
+		return x;
+	}
+
+	int32_t x = pos + (int32_t)bam_cigar2rlen(n, cigar) - 1;
+	for(int k = n - 1; k >= 0; k--)
+	{
+		int op = bam_cigar_op(cigar[k]);
+		if(op != BAM_CSOFT_CLIP && op != BAM_CHARD_CLIP) break;
+		x += bam_cigar_oplen(cigar[k]);
+	}
+	return x;
+}
+
+int parse_cigar(const char *s, vector<uint32_t> &cigar)
+{
+	cigar.clear();
+	while(*s != '\0')
+	{
+		if(isdigit(*s) == false) return -1;
+		char *e;
+		uint32_t l = strtoul(s, &e, 10);
+		const char *c = strchr(BAM_CIGAR_STR, *e);
+		if(*e == '\0' || c == NULL) return -1;
+		cigar.push_back(bam_cigar_gen(l, c - BAM_CIGAR_STR));
+		s = e + 1;
+	}
+	return 0;
+}
+
+// c / x = 1 - exp(-n / x), solved by bisection as in Picard
+static double library_size_function(double x, double c, double n)
+{
+	return c / x - 1 + exp(-n / x);
+}
+
+double estimate_library_size(int64_t n, int64_t c)
+{
+	if(c <= 0 || c >= n) return 0;
+	if(library_size_function(c, c, n) < 0) return 0;
+
+	double m = 1.0;
+	double M = 100.0;
+	while(library_size_function(M * c, c, n) > 0) M *= 10.0;
+
+	for(int i = 0; i < 40; i++)
+	{
+		double r = (m + M) / 2.0;
+		double u = library_size_function(r * c, c, n);
+		if(u == 0) break;
+		else if(u > 0) m = r;
+		else M = r;
+	}
+	return c * (m + M) / 2.0;
+}
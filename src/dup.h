@@ -0,0 +1,48 @@
+#ifndef __DUP_H__
+#define __DUP_H__
+
+#include "collector.h"
+
+using namespace std;
+
+#define DUP_PARTITION_BITS 6
+
+/*
+ fragments are reduced to 64-bit fingerprints of the chromosome, the
+ unclipped 5' positions and the strands of both mates; fingerprints of
+ pairs and of single ends are each routed to 2^DUP_PARTITION_BITS partitions
+ by their top bits, and the partitions are counted in open-addressing
+ tables by opt.threads threads
+*/
+class dup_collector: public collector
+{
+public:
+	dup_collector(const options &opt);
+
+public:
+	int64_t pairs;						// fragments with both mates mapped
+	int64_t singles;					// single-end reads or with the mate unmapped
+	int64_t unique_pairs;
+	int64_t unique_singles;
+
+public:
+	int add(bam1_t *b);
+	int finish();						// count distinct fingerprints
+	int print() const;
+	string json() const;
+	double duplicate_rate() const;
+	double library_size() const;		// as estimated by Picard, 0 if unknown
+
+private:
+	vector< vector<uint64_t> > parts;	// singles first, then pairs
+	bool finished;
+
+private:
+	int64_t count_partition(int k) const;
+};
+
+int32_t unclipped_5prime(int32_t pos, bool reverse, const uint32_t *cigar, int n);
+int parse_cigar(const char *s, vector<uint32_t> &cigar);
+double estimate_library_size(int64_t n, int64_t c);
+
+#endif
@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+
+#include "edit.h"
+
+edit_collector::edit_collector(const options &o, const bam_hdr_t *h, bool d)
+	: collector(o), hdr(h), detail(d)
+{
+	min_mapping_quality = opt.min_mapping_quality;
+	reads = 0;
+	mdreads = 0;
+	nmvec.assign(MAX_EDIT_BIN + 1, 0);
+	int n = (hdr == NULL) ? 0 : hdr->n_targets;
+	bases.assign(n, 0);
+	edits.assign(n, 0);
+}
+
+int edit_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x904) >= 1) return 0;		// unmapped, secondary or supplementary
+	if(p.qual < min_mapping_quality) return 0;
+	if(p.tid < 0) return 0;
+
+	int32_t nm = edit_distance(b);
+	if(nm < 0) return 0;
+
+	reads++;
+	nmvec[nm < MAX_EDIT_BIN ? nm : MAX_EDIT_BIN]++;
+
+	int64_t m = 0;
+	uint32_t *cigar = bam_get_cigar(b);
+	for(int k = 0; k < p.n_cigar; k++)
+	{
+		int op = bam_cigar_op(cigar[k]);
+		if(op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF) m += bam_cigar_oplen(cigar[k]);
+	}
+
+	if(p.tid >= bases.size()) bases.resize(p.tid + 1, 0);
+	if(p.tid >= edits.size()) edits.resize(p.tid + 1, 0);
+	bases[p.tid] += m;
+	edits[p.tid] += nm;
+
+	uint8_t *md = bam_aux_get(b, "MD");
+	if(md != NULL && *md == 'Z') add_md(b, bam_aux2Z(md));
+	return 0;
+}
+
+/*
+ MD lists matched lengths, mismatched reference bases and ^-prefixed
+ deletions along the aligned (M/=/X) bases; the cigar maps these
+ offsets back to query positions
+*/
+int edit_collector::add_md(bam1_t *b, const char *md)
+{
+	bam1_core_t &p = b->core;
+
+	mpos.clear();
+	int k = 0;
+	for(const char *s = md; *s != '\0';)
+	{
+		if(isdigit(*s))
+		{
+			char *e;
+			k += strtol(s, &e, 10);
+			s = e;
+		}
+		else if(*s == '^')
+		{
+			s++;
+			while(isalpha(*s)) s++;
+		}
+		else
+		{
+			mpos.push_back(k);
+			k++;
+			s++;
+		}
+	}
+
+	int l = (int)bam_cigar2qlen(p.n_cigar, bam_get_cigar(b));
+	if(p.l_qseq > 0 && p.l_qseq != l) return 0;		// inconsistent with the sequence
+	if(l <= 0) return 0;
+	if(l >= covered.size()) covered.resize(l + 1, 0);
+	if(l > mismatch.size()) mismatch.resize(l, 0);
+
+	bool rev = ((p.flag & 0x10) >= 1);
+	int q = 0, a = 0, j = 0;			// query position, aligned offset, index in mpos
+	uint32_t *cigar = bam_get_cigar(b);
+	for(int i = 0; i < p.n_cigar; i++)
+	{
+		int op = bam_cigar_op(cigar[i]);
+		int len = bam_cigar_oplen(cigar[i]);
+		if(op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF)
+		{
+			int s = rev ? l - q - len : q;
+			covered[s]++;
+			covered[s + len]--;
+			for(; j < mpos.size() && mpos[j] < a + len; j++)
+			{
+				int x = q + mpos[j] - a;
+				mismatch[rev ? l - 1 - x : x]++;
+			}
+			q += len;
+			a += len;
+		}
+		else if(op == BAM_CINS || op == BAM_CSOFT_CLIP)
+		{
+			q += len;
+		}
+	}
+
+	mdreads++;
+	return 0;
+}
+
+collector *edit_collector::spawn() const
+{
+	return new edit_collector(opt, hdr, detail);
+}
+
+static void add_to(vector<int64_t> &x, const vector<int64_t> &y)
+{
+	if(y.size() > x.size()) x.resize(y.size(), 0);
+	for(int i = 0; i < y.size(); i++) x[i] += y[i];
+}
+
+int edit_collector::merge(const collector &c)
+{
+	const edit_collector &x = dynamic_cast<const edit_collector&>(c);
+	reads += x.reads;
+	mdreads += x.mdreads;
+	add_to(nmvec, x.nmvec);
+	add_to(bases, x.bases);
+	add_to(edits, x.edits);
+	add_to(mismatch, x.mismatch);
+	add_to(covered, x.covered);
+	return 0;
+}
+
+int edit_collector::print() const
+{
+	int64_t m = 0, e = 0;
+	for(int i = 0; i < bases.size(); i++) m += bases[i];
+	for(int i = 0; i < edits.size(); i++) e += edits[i];
+	printf("alignments with NM = %ld aligned bases = %ld edits = %ld error rate = %.6lf\n", reads, m, e, (m > 0 ? 1.0 * e / m : 0));
+	if(detail == false) return 0;
+
+	for(int i = 0; i < nmvec.size(); i++)
+	{
+		printf("NM\t%d%s\t%ld\n", i, (i == MAX_EDIT_BIN) ? "+" : "", nmvec[i]);
+	}
+
+	for(int i = 0; i < bases.size(); i++)
+	{
+		if(bases[i] <= 0) continue;
+		const char *chr = (hdr != NULL && i < hdr->n_targets) ? hdr->target_name[i] : "*";
+		printf("CONTIG\t%s\t%ld\t%ld\t%.6lf\n", chr, bases[i], edits[i], 1.0 * edits[i] / bases[i]);
+	}
+
+	if(mdreads <= 0) return 0;
+
+	int64_t c = 0;
+	for(int i = 0; i < mismatch.size(); i++)
+	{
+		c += covered[i];
+		if(c <= 0) continue;
+		printf("MISMATCH\t%d\t%ld\t%ld\t%.6lf\n", i + 1, mismatch[i], c, 1.0 * mismatch[i] / c);
+	}
+	return 0;
+}
+
+string edit_collector::json() const
+{
+	int64_t m = 0, e = 0;
+	for(int i = 0; i < bases.size(); i++) m += bases[i];
+	for(int i = 0; i < edits.size(); i++) e += edits[i];
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"alignments\":%ld,\"aligned_bases\":%ld,\"edits\":%ld,\"md_alignments\":%ld}", reads, m, e, mdreads);
+	return string(buf);
+}
@@ -0,0 +1,43 @@
+#ifndef __EDIT_H__
+#define __EDIT_H__
+
+#include "collector.h"
+
+using namespace std;
+
+#define MAX_EDIT_BIN 50				// NM >= MAX_EDIT_BIN share the last bin
+
+/*
+ edit distances (NM/nM) of primary alignments: histogram, error rate
+ per contig and, when MD is present, mismatches per sequencing cycle
+*/
+class edit_collector: public collector
+{
+public:
+	edit_collector(const options &opt, const bam_hdr_t *hdr, bool detail);
+
+public:
+	const bam_hdr_t *hdr;
+	bool detail;						// print histogram and profiles
+	int64_t reads;						// alignments with NM/nM
+	vector<int64_t> nmvec;				// histogram of edit distances
+	vector<int64_t> bases;				// aligned (M/=/X) bases per contig
+	vector<int64_t> edits;				// sum of edit distances per contig
+	int64_t mdreads;					// alignments with MD
+	vector<int64_t> mismatch;			// mismatches per cycle
+	vector<int64_t> covered;			// difference array of aligned bases per cycle
+
+public:
+	int add(bam1_t *b);
+	int print() const;
+	string json() const;
+	collector *spawn() const;
+	int merge(const collector &c);
+	int add_md(bam1_t *b, const char *md);
+
+private:
+	uint32_t min_mapping_quality;
+	vector<int> mpos;					// mismatch offsets among aligned bases
+};
+
+#endif
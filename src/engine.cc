@@ -0,0 +1,217 @@
+#include <cstdio>
+#include <ctime>
+
+#include "engine.h"
+#include "stream.h"
+#include "collate.h"
+
+engine::engine()
+{
+	records = 0;
+	report_records = 0;
+	report_seconds = 0;
+	sharded = false;
+	timing = false;
+	meter = NULL;
+	fraction = 1.0;
+	dropped = 0;
+	reported = 0;
+	last = 0;
+	b1t = bam_init1();
+}
+
+engine::~engine()
+{
+	bam_destroy1(b1t);
+}
+
+int engine::push(collector *c)
+{
+	collectors.push_back(c);
+	return 0;
+}
+
+int engine::add(bam1_t *b)
+{
+	bool timed = (PROBES_ENABLED && timing == true && records % PROBE_PERIOD == 0);
+	records++;
+	bool sampled = (fraction >= 1.0 || sampled_read(b, fraction) == true);
+	for(int i = 0; i < collectors.size() && sampled == true; i++)
+	{
+		if(collectors[i]->done() == true) continue;
+		if(timed == false) collectors[i]->add(b);
+		if(timed == false) continue;
+
+		double t = current_time();
+		collectors[i]->add(b);
+		collectors[i]->probe.time(current_time() - t);
+	}
+	if(report_records > 0 || report_seconds > 0) check();
+	return 0;
+}
+
+bool engine::done() const
+{
+	if(collectors.size() == 0) return true;
+	for(int i = 0; i < collectors.size(); i++)
+	{
+		if(collectors[i]->done() == false) return false;
+	}
+	return true;
+}
+
+bool engine::unmapped() const
+{
+	for(int i = 0; i < collectors.size(); i++)
+	{
+		if(collectors[i]->unmapped() == true) return true;
+	}
+	return false;
+}
+
+int engine::run(samFile *sfn, bam_hdr_t *hdr)
+{
+	last = current_time();
+	sharded = false;
+
+	if(sam_scanner::applicable(sfn) == true)
+	{
+		sam_scanner sc(sfn, hdr, unmapped() == false);
+		int64_t d = 0;
+		int r = 0;
+		while(done() == false && (r = sc.next(b1t)) >= 0)
+		{
+			// unmapped lines the scanner dropped count as skipped, as if they were parsed
+			if(sc.dropped > d) skip_unmapped(sc.dropped - d);
+			d = sc.dropped;
+			if(r == 1 && (report_records > 0 || report_seconds > 0)) check();
+			if(r == 1) continue;
+			add(b1t);
+			if(meter != NULL && records % PROGRESS_PERIOD == 0) meter->update(sfn, PROGRESS_PERIOD);
+		}
+		if(sc.dropped > d) skip_unmapped(sc.dropped - d);
+		if(meter != NULL) meter->update(sfn, records % PROGRESS_PERIOD);
+		return 0;
+	}
+
+	while(done() == false && sam_read1(sfn, hdr, b1t) >= 0)
+	{
+		add(b1t);
+		if(meter != NULL && records % PROGRESS_PERIOD == 0) meter->update(sfn, PROGRESS_PERIOD);
+	}
+	if(meter != NULL) meter->update(sfn, records % PROGRESS_PERIOD);
+	return 0;
+}
+
+/*
+ records after the current position of sfn are split into shards of
+ the file; every thread feeds its own spawned copies of the collectors,
+ which are merged at the end, so only order-independent ones qualify
+*/
+int engine::run_shards(const string &file, samFile *sfn, bam_hdr_t *hdr, int threads)
+{
+	if(threads <= 1 || collectors.size() == 0) return -1;
+	if(bgzf_shards::applicable(sfn, file) == false) return -1;
+
+	vector< vector<collector*> > local(threads);
+	bool spawned = true;
+	for(int w = 0; w < threads; w++)
+	{
+		for(int i = 0; i < collectors.size(); i++)
+		{
+			collector *c = collectors[i]->spawn();
+			if(c == NULL) spawned = false;
+			local[w].push_back(c);
+		}
+	}
+
+	if(spawned == true)
+	{
+		bgzf_shards sh(file, hdr);
+		sh.build(bgzf_tell(sfn->fp.bgzf), threads * SHARDS_PER_THREAD);
+
+		vector<int64_t> counts(threads, 0);
+		bool timing = this->timing;
+		double fraction = this->fraction;
+		int f = sh.run(threads, [&local, &counts, timing, fraction](int w, int k, bam1_t *b)
+		{
+			bool timed = (PROBES_ENABLED && timing == true && counts[w] % PROBE_PERIOD == 0);
+			counts[w]++;
+			if(fraction < 1.0 && sampled_read(b, fraction) == false) return true;
+			bool more = false;
+			for(int i = 0; i < local[w].size(); i++)
+			{
+				if(local[w][i]->done() == true) continue;
+				double t = timed ? current_time() : 0;
+				local[w][i]->add(b);
+				if(timed == true) local[w][i]->probe.time(current_time() - t);
+				if(local[w][i]->done() == false) more = true;
+			}
+			return more;
+		}, meter);
+		if(f < 0) printf("fail to read %s\n", file.c_str());
+		if(f < 0) exit(0);
+
+		for(int w = 0; w < threads; w++)
+		{
+			records += counts[w];
+			for(int i = 0; i < collectors.size(); i++) collectors[i]->merge(*local[w][i]);
+			for(int i = 0; i < collectors.size(); i++) collectors[i]->probe.merge(local[w][i]->probe);
+		}
+		sharded = true;
+	}
+
+	for(int w = 0; w < threads; w++)
+	{
+		for(int i = 0; i < local[w].size(); i++) delete local[w][i];
+	}
+	return spawned ? 0 : -1;
+}
+
+int engine::skip_unmapped(int64_t n)
+{
+	dropped += n;
+	for(int i = 0; i < collectors.size(); i++)
+	{
+		if(collectors[i]->done() == true) continue;
+		collectors[i]->probe.skip(SKIP_UNMAPPED, n);
+	}
+	return 0;
+}
+
+// the clock is read for every record (a few tens of ns), so a slow input or
+// one of mostly dropped lines is reported on time; dropped lines count as records
+int engine::check()
+{
+	int64_t n = records + dropped;
+	bool b = false;
+	if(report_records > 0 && n - reported >= report_records) b = true;
+	if(report_seconds > 0 && current_time() - last >= report_seconds) b = true;
+	if(b == false) return 0;
+
+	report();
+	last = current_time();
+	reported = n;
+	return 0;
+}
+
+int engine::report() const
+{
+	string s = "{\"records\":" + tostring(records) + ",\"results\":[";
+	for(int i = 0; i < collectors.size(); i++)
+	{
+		if(i >= 1) s += ",";
+		s += collectors[i]->json();
+	}
+	s += "]}";
+	fprintf(stderr, "%s\n", s.c_str());
+	fflush(stderr);
+	return 0;
+}
+
+double current_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,53 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "collector.h"
+#include "shard.h"
+
+#define SHARDS_PER_THREAD 4
+
+using namespace std;
+
+/*
+ single-pass driver: every record is decoded once and
+ handed to all registered collectors
+*/
+class engine
+{
+public:
+	engine();
+	~engine();
+
+public:
+	vector<collector*> collectors;			// not owned
+	int64_t records;						// records seen so far
+	int64_t dropped;						// unmapped lines dropped by sam_scanner so far
+	int64_t report_records;					// print partial results every so many records, 0: never
+	double report_seconds;					// print partial results every so many seconds, 0: never
+	bool sharded;							// whether the last run used run_shards
+	bool timing;							// time add() of one record in PROBE_PERIOD
+	progress_meter *meter;					// not owned, NULL for no progress
+	double fraction;						// of read names given to the collectors (sampled_read)
+
+public:
+	int push(collector *c);
+	int add(bam1_t *b);						// feed one record
+	bool done() const;						// whether all collectors are satisfied
+	int run(samFile *sfn, bam_hdr_t *hdr);	// scan the rest of an open file
+	int run_shards(const string &file, samFile *sfn, bam_hdr_t *hdr, int threads);	// in parallel, -1 if not possible
+	int report() const;						// print partial results to stderr
+
+private:
+	bam1_t *b1t;
+	double last;							// time of the last report
+	int64_t reported;						// records + dropped at the last report
+
+private:
+	bool unmapped() const;
+	int skip_unmapped(int64_t n);			// records dropped by sam_scanner
+	int check();
+};
+
+double current_time();
+
+#endif
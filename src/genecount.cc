@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "genecount.h"
+#include "util.h"
+
+gene_index::gene_index(const annotation &gtf, const bam_hdr_t *hdr)
+{
+	map<string, int32_t> m;
+	for(int t = 0; t < gtf.names.size(); t++)
+	{
+		int32_t tid = bam_name2id(const_cast<bam_hdr_t*>(hdr), gtf.chrs[t].c_str());
+		if(tid < 0) continue;
+
+		const string &g = gtf.genes[t].size() >= 1 ? gtf.genes[t] : gtf.names[t];
+		map<string, int32_t>::iterator it = m.find(g);
+		if(it == m.end())
+		{
+			it = m.insert(make_pair(g, (int32_t)genes.size())).first;
+			genes.push_back(g);
+			strands.push_back(gtf.strands[t]);
+		}
+
+		for(int k = gtf.offset[t]; k < gtf.offset[t + 1]; k++)
+		{
+			exons.add(tid, gtf.starts[k], gtf.ends[k], it->second);
+		}
+	}
+	exons.build();
+}
+
+int gene_index::overlap(const hit &ht, vector<int32_t> &v) const
+{
+	v.clear();
+	vector<int64_t> blocks;
+	ht.get_matched_intervals(blocks);
+	for(int i = 0; i < blocks.size(); i++)
+	{
+		exons.overlap(ht.tid, high32(blocks[i]), low32(blocks[i]), v);
+	}
+
+	sort(v.begin(), v.end());
+	v.erase(unique(v.begin(), v.end()), v.end());
+	return 0;
+}
+
+int gene_index::assign(const hit &ht, vector<int32_t> &v) const
+{
+	overlap(ht, v);
+
+	// genes on the other strand do not count
+	int n = 0;
+	for(int i = 0; i < v.size(); i++)
+	{
+		char s = strands[v[i]];
+		if(ht.strand != '.' && s != '.' && s != ht.strand) continue;
+		v[n++] = v[i];
+	}
+	v.resize(n);
+	return 0;
+}
+
+char gene_index::strand(const hit &ht, vector<int32_t> &v) const
+{
+	overlap(ht, v);
+
+	char s = '.';
+	for(int i = 0; i < v.size(); i++)
+	{
+		char c = strands[v[i]];
+		if(c != '+' && c != '-') return '.';
+		if(s != '.' && c != s) return '.';
+		s = c;
+	}
+	return s;
+}
+
+genecount_collector::genecount_collector(const options &o, shared_ptr<const gene_index> x, bool d)
+	: collector(o), index(x), detail(d)
+{
+	counts.assign(index->genes.size(), 0);
+	assigned = 0;
+	ambiguous = 0;
+	no_feature = 0;
+	min_mapping_quality = opt.min_mapping_quality;
+	second_mask = opt.use_second_alignment ? 0 : 0x100;
+}
+
+int genecount_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x4) >= 1) return 0;
+	if((p.flag & second_mask) >= 1) return 0;
+	if((p.flag & 0x800) >= 1) return 0;
+	if(p.n_cigar > MAX_NUM_CIGAR) return 0;
+	if(p.n_cigar < 1) return 0;
+	if(p.qual < min_mapping_quality) return 0;
+
+	if(opt.library_type == FR_FIRST) return count(hit(b, 5, library<FR_FIRST>()));
+	if(opt.library_type == FR_SECOND) return count(hit(b, 5, library<FR_SECOND>()));
+	return count(hit(b, 5, library<UNSTRANDED>()));
+}
+
+int genecount_collector::count(const hit &ht)
+{
+	index->assign(ht, hits);
+	if(hits.size() == 0) no_feature++;
+	if(hits.size() >= 2) ambiguous++;
+	if(hits.size() != 1) return 0;
+
+	counts[hits[0]]++;
+	assigned++;
+	return 0;
+}
+
+collector *genecount_collector::spawn() const
+{
+	return new genecount_collector(opt, index, detail);
+}
+
+int genecount_collector::merge(const collector &c)
+{
+	const genecount_collector &x = dynamic_cast<const genecount_collector&>(c);
+	for(int i = 0; i < counts.size() && i < x.counts.size(); i++) counts[i] += x.counts[i];
+	assigned += x.assigned;
+	ambiguous += x.ambiguous;
+	no_feature += x.no_feature;
+	return 0;
+}
+
+int genecount_collector::print() const
+{
+	int64_t n = assigned + ambiguous + no_feature;
+	printf("genes = %lu assigned reads = %ld (%.4lf) ambiguous = %ld no feature = %ld\n",
+			counts.size(), assigned, (n > 0 ? 1.0 * assigned / n : 0), ambiguous, no_feature);
+	if(detail == false) return 0;
+
+	for(int i = 0; i < counts.size(); i++)
+	{
+		printf("%s\t%ld\n", index->genes[i].c_str(), counts[i]);
+	}
+	return 0;
+}
+
+string genecount_collector::json() const
+{
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"genes\":%lu,\"assigned\":%ld,\"ambiguous\":%ld,\"no_feature\":%ld}", counts.size(), assigned, ambiguous, no_feature);
+	return string(buf);
+}
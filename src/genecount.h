@@ -0,0 +1,62 @@
+#ifndef __GENECOUNT_H__
+#define __GENECOUNT_H__
+
+#include "collector.h"
+#include "annotation.h"
+#include "interval.h"
+#include <memory>
+
+using namespace std;
+
+// exons of an annotation by gene, on the contigs of a bam header
+class gene_index
+{
+public:
+	gene_index(const annotation &gtf, const bam_hdr_t *hdr);
+
+public:
+	vector<string> genes;				// gene ids
+	vector<char> strands;				// strand of each gene
+	interval_index exons;				// exons, valued by gene
+
+public:
+	int overlap(const hit &ht, vector<int32_t> &v) const;	// distinct genes hit by the matched blocks of ht
+	int assign(const hit &ht, vector<int32_t> &v) const;	// those on the strand of ht
+	char strand(const hit &ht, vector<int32_t> &v) const;	// common strand of the genes hit, '.' if none or both
+};
+
+/*
+ reads per gene as featureCounts does by default: a read counts for a
+ gene if its aligned blocks overlap exons of that gene only, on the
+ strand given by --library_type; pairs count once per mate
+*/
+class genecount_collector: public collector
+{
+public:
+	genecount_collector(const options &opt, shared_ptr<const gene_index> index, bool detail);
+
+public:
+	shared_ptr<const gene_index> index;	// shared by spawned collectors
+	bool detail;						// print every gene
+	vector<int64_t> counts;				// reads per gene
+	int64_t assigned;
+	int64_t ambiguous;					// overlapping more than one gene
+	int64_t no_feature;					// overlapping no gene
+
+public:
+	int add(bam1_t *b);
+	int print() const;
+	string json() const;
+	collector *spawn() const;
+	int merge(const collector &c);
+
+private:
+	uint32_t min_mapping_quality;
+	uint16_t second_mask;
+	vector<int32_t> hits;
+
+private:
+	int count(const hit &ht);
+};
+
+#endif
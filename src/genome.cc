@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "genome.h"
+#include "util.h"
+
+packed_genome::packed_genome(const string &fasta, const bam_hdr_t *hdr)
+{
+	data = NULL;
+	size = 0;
+
+	string file = fasta + GENOME_SUFFIX;
+	struct stat sa, sb;
+	if(stat(fasta.c_str(), &sa) != 0) printf("fail to open reference %s\n", fasta.c_str());
+	if(stat(fasta.c_str(), &sa) != 0) exit(0);
+
+	if(stat(file.c_str(), &sb) == 0 && sb.st_mtime >= sa.st_mtime && map(file, hdr) == 0) return;
+
+	int f = build(fasta, file);
+	if(f != 0) printf("fail to write packed reference %s\n", file.c_str());
+	if(f != 0) exit(0);
+
+	f = map(file, hdr);
+	if(f != 0) printf("fail to map packed reference %s\n", file.c_str());
+	if(f != 0) exit(0);
+}
+
+packed_genome::~packed_genome()
+{
+	if(data != NULL) munmap((void*)data, size);
+}
+
+int packed_genome::map(const string &file, const bam_hdr_t *hdr)
+{
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0) return -1;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < 24)
+	{
+		close(fd);
+		return -1;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) return -1;
+
+	data = (const uint8_t*)p;
+	size = st.st_size;
+	madvise(p, size, MADV_RANDOM);
+
+	uint64_t index, n;
+	memcpy(&index, data + 8, 8);
+	memcpy(&n, data + 16, 8);
+	if(memcmp(data, GENOME_MAGIC, 8) != 0 || index > size)
+	{
+		munmap(p, size);
+		data = NULL;
+		return -1;
+	}
+
+	offsets.assign(hdr->n_targets, -1);
+	lengths.assign(hdr->n_targets, 0);
+
+	const uint8_t *q = data + index;
+	for(uint64_t i = 0; i < n; i++)
+	{
+		const uint8_t *z = (const uint8_t*)memchr(q, '\0', data + size - q);
+		if(z == NULL || z + 17 > data + size) break;
+
+		int64_t offset, length;
+		memcpy(&offset, z + 1, 8);
+		memcpy(&length, z + 9, 8);
+
+		int tid = bam_name2id(const_cast<bam_hdr_t*>(hdr), (const char*)q);
+		if(tid >= 0 && offset + (length + 3) / 4 <= (int64_t)index)
+		{
+			offsets[tid] = offset;
+			lengths[tid] = length;
+		}
+		q = z + 17;
+	}
+	return 0;
+}
+
+// packs fasta into file through a temporary file, so readers never see a partial one
+int packed_genome::build(const string &fasta, const string &file)
+{
+	FILE *fin = fopen(fasta.c_str(), "r");
+	if(fin == NULL) return -1;
+
+	string tmp = file + "." + tostring(getpid());
+	FILE *fout = fopen(tmp.c_str(), "w");
+	if(fout == NULL)
+	{
+		fclose(fin);
+		return -1;
+	}
+
+	uint8_t code[256];
+	memset(code, 0, sizeof(code));
+	code['C'] = code['c'] = 1;
+	code['G'] = code['g'] = 2;
+	code['T'] = code['t'] = 3;
+
+	char head[24];
+	memset(head, 0, sizeof(head));
+	fwrite(head, 1, sizeof(head), fout);
+
+	vector<string> names;
+	vector<int64_t> offsets, lengths;
+	int64_t offset = sizeof(head);
+	uint8_t byte = 0;
+
+	char line[65536];
+	while(fgets(line, sizeof(line), fin) != NULL)
+	{
+		if(line[0] == '>')
+		{
+			if(names.size() >= 1 && lengths.back() % 4 != 0) fputc(byte, fout);
+			if(names.size() >= 1) offset += (lengths.back() + 3) / 4;
+
+			char *s = line + 1;
+			s[strcspn(s, " \t\r\n")] = '\0';
+			names.push_back(s);
+			offsets.push_back(offset);
+			lengths.push_back(0);
+			byte = 0;
+			continue;
+		}
+		if(names.size() == 0) continue;
+
+		int64_t &n = lengths.back();
+		for(char *s = line; *s != '\0' && *s != '\n' && *s != '\r'; s++)
+		{
+			byte |= code[(uint8_t)(*s)] << (2 * (n % 4));
+			n++;
+			if(n % 4 != 0) continue;
+			fputc(byte, fout);
+			byte = 0;
+		}
+	}
+	if(names.size() >= 1 && lengths.back() % 4 != 0) fputc(byte, fout);
+	if(names.size() >= 1) offset += (lengths.back() + 3) / 4;
+	fclose(fin);
+
+	for(int i = 0; i < names.size(); i++)
+	{
+		fwrite(names[i].c_str(), 1, names[i].size() + 1, fout);
+		fwrite(&offsets[i], 8, 1, fout);
+		fwrite(&lengths[i], 8, 1, fout);
+	}
+
+	uint64_t index = offset, n = names.size();
+	memcpy(head, GENOME_MAGIC, 8);
+	memcpy(head + 8, &index, 8);
+	memcpy(head + 16, &n, 8);
+	fseek(fout, 0, SEEK_SET);
+	fwrite(head, 1, sizeof(head), fout);
+
+	bool fail = (ferror(fout) != 0);
+	if(fclose(fout) != 0) fail = true;
+	if(fail == true || rename(tmp.c_str(), file.c_str()) != 0)
+	{
+		unlink(tmp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+char packed_genome::base(int32_t tid, int32_t p) const
+{
+	if(tid < 0 || tid >= offsets.size() || offsets[tid] < 0) return 'N';
+	if(p < 0 || p >= lengths[tid]) return 'N';
+	return "ACGT"[(data[offsets[tid] + p / 4] >> (2 * (p % 4))) & 0x3];
+}
+
+/*
+ GT-AG, GC-AG and AT-AC introns are on the forward strand, their
+ reverse complements CT-AC, CT-GC and GT-AT on the reverse strand
+*/
+char packed_genome::motif(int32_t tid, int32_t s, int32_t e) const
+{
+	if(e - s < 4) return '.';
+
+	char m[5] = {base(tid, s), base(tid, s + 1), base(tid, e - 2), base(tid, e - 1), '\0'};
+	if(strcmp(m, "GTAG") == 0 || strcmp(m, "GCAG") == 0 || strcmp(m, "ATAC") == 0) return '+';
+	if(strcmp(m, "CTAC") == 0 || strcmp(m, "CTGC") == 0 || strcmp(m, "GTAT") == 0) return '-';
+	return '.';
+}
@@ -0,0 +1,46 @@
+#ifndef __GENOME_H__
+#define __GENOME_H__
+
+#include <htslib/sam.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+#define GENOME_MAGIC "bk2bit01"			// 8 bytes, bumped whenever the layout changes
+#define GENOME_SUFFIX ".bamkit.2bit"	// the packed genome is cached next to the FASTA
+
+/*
+ a FASTA file packed to 2 bits per base (A, C, G, T; other bases are
+ stored as A) and memory-mapped, so that random lookups of splice
+ motifs only touch the pages they need; the packed file is built on
+ first use and rebuilt when the FASTA is newer. Layout: magic, offset
+ of the index and number of contigs (uint64 each), the packed contigs,
+ each starting on a byte, base i of a contig in bits 2(i%4) of byte
+ i/4, then per contig its name, '\0', offset and length (uint64)
+*/
+class packed_genome
+{
+public:
+	packed_genome(const string &fasta, const bam_hdr_t *hdr);
+	~packed_genome();
+
+public:
+	char base(int32_t tid, int32_t p) const;				// 'N' if outside of the genome
+	char motif(int32_t tid, int32_t s, int32_t e) const;	// strand of the canonical intron [s, e), '.' if none
+
+public:
+	static int build(const string &fasta, const string &file);
+
+private:
+	const uint8_t *data;
+	size_t size;
+	vector<int64_t> offsets;			// of the contigs of the bam header, -1 if absent
+	vector<int64_t> lengths;
+
+private:
+	int map(const string &file, const bam_hdr_t *hdr);
+};
+
+#endif
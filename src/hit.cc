@@ -1,4 +1,5 @@
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 #include <cstdio>
 #include <sstream>
@@ -17,23 +18,29 @@ hit::hit(int32_t p)
 	nh = -1;
 	nm = 0;
 	qlen = 0;
+	concordant = false;
 }
 
-hit::hit(const hit &h)
-	:bam1_core_t(h)
+// indexed by (flag >> 3) & 0x1F; odd entries have the mate unmapped
+template<> const char library<UNSTRANDED>::strand[32] = {
+	'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',
+	'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.'};
+
+template<> const char library<FR_FIRST>::strand[32] = {
+	'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '+', '.', '-', '.', '.', '.',		// R1F2, F1R2
+	'.', '.', '-', '.', '+', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.'};		// R2F1, F2R1
+
+template<> const char library<FR_SECOND>::strand[32] = {
+	'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '-', '.', '+', '.', '.', '.',		// R1F2, F1R2
+	'.', '.', '+', '.', '-', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.'};		// R2F1, F2R1
+
+hit::hit(bam1_t *b, int depth)
+	:hit(b, depth, library<UNSTRANDED>())
 {
-	rpos = h.rpos;
-	qlen = h.qlen;
-	qname = h.qname;
-	strand = h.strand;
-	spos = h.spos;
-	xs = h.xs;
-	hi = h.hi;
-	nm = h.nm;
-	memcpy(cigar, h.cigar, sizeof cigar);
 }
 
-hit::hit(bam1_t *b, int depth)
+template<int L>
+hit::hit(bam1_t *b, int depth, library<L>)
 	:bam1_core_t(b->core)
 {
 	if(depth <= 0) return;
@@ -43,29 +50,11 @@ hit::hit(bam1_t *b, int depth)
 	qlen = (int32_t)bam_cigar2qlen(n_cigar, bam_get_cigar(b));
 	if(depth <= 1) return;
 
-	// get concordance
-	strand = '.';
-	bool concordant = false;
-	if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) concordant = true;		// F1R2
-	if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) concordant = true;		// R1F2
-	if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) concordant = true;		// F2R1
-	if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) concordant = true;		// R2F1
-
-	// get strandness
-	if(library_type == FR_FIRST && ((flag & 0x8) <= 0))
-	{
-		if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) strand = '-';		// F1R2
-		if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) strand = '+';		// R1F2
-		if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) strand = '+';		// F2R1
-		if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) strand = '-';		// R2F1
-	}
-	if(library_type == FR_SECOND && ((flag & 0x8) <= 0))
-	{
-		if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) strand = '+';		// F1R2
-		if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) >= 1 && (flag & 0x80) <= 0) strand = '-';		// R1F2
-		if((flag & 0x10) <= 0 && (flag & 0x20) >= 1 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) strand = '-';		// F2R1
-		if((flag & 0x10) >= 1 && (flag & 0x20) <= 0 && (flag & 0x40) <= 0 && (flag & 0x80) >= 1) strand = '+';		// R2F1
-	}
+	// get concordance, one of F1R2, R1F2, F2R1 and R2F1
+	concordant = ((0x660 >> ((flag >> 4) & 0xF)) & 0x1);
+
+	// get strandness, no branch on the library type
+	strand = library<L>::strand[(flag >> 3) & 0x1F];
 	if(depth <= 2) return;
 
 	xs = '.';
@@ -73,25 +62,15 @@ hit::hit(bam1_t *b, int depth)
 	if(p1 && (*p1) == 'A') xs = bam_aux2A(p1);
 
 	// if mate pair is unmapped, trust XS
-	if(library_type == FR_FIRST && (flag & 0x8) >= 1) strand = xs;
-	if(library_type == FR_SECOND && (flag & 0x8) >= 1) strand = xs;
+	if(L != UNSTRANDED && (flag & 0x8) >= 1) strand = xs;
 	if(depth <= 3) return;
 
 	// fetch tags
-	hi = -1;
-	uint8_t *p2 = bam_aux_get(b, "HI");
-	if(p2 && (*p2) == 'i') hi = bam_aux2i(p2);
+	hi = aux_integer(bam_aux_get(b, "HI"), -1);
+	nh = aux_integer(bam_aux_get(b, "NH"), -1);
 
-	nh = -1;
-	uint8_t *p3 = bam_aux_get(b, "NH");
-	if(p3 && (*p3) == 'C') nh = bam_aux2i(p3);
-
-	nm = 0;
-	uint8_t *p4 = bam_aux_get(b, "nM");
-	if(p4 && (*p4) == 'C') nm = bam_aux2i(p4);
-
-	uint8_t *p5 = bam_aux_get(b, "NM");
-	if(p5 && (*p5) == 'C') nm = bam_aux2i(p5);
+	nm = edit_distance(b);
+	if(nm < 0) nm = 0;
 
 	if(depth <= 4) return;
 
@@ -106,12 +85,13 @@ hit::hit(bam1_t *b, int depth)
 	buf[l_qname] = '\0';
 	qname = string(buf);
 	if(depth <= 5) return;
-
-	build_splice_positions();
-	if(depth <= 6) return;
 }
 
-bool hit::verify_junctions()
+template hit::hit(bam1_t *b, int depth, library<UNSTRANDED>);
+template hit::hit(bam1_t *b, int depth, library<FR_FIRST>);
+template hit::hit(bam1_t *b, int depth, library<FR_SECOND>);
+
+bool hit::verify_junctions(const options &opt) const
 {
 	int32_t p = pos;
 	int32_t q = 0;
@@ -136,14 +116,14 @@ bool hit::verify_junctions()
 		//if(log2(s) > log2(10) + (2 * m) && nh >= 2)
 		if(log2(s) > log2(10) + (2 * m))
 		{
-			if(verbose >= 2) printf("detect super long junction %d with matches (%d, %d)\n", s, m1, m2);
+			if(opt.verbose >= 2) printf("detect super long junction %d with matches (%d, %d)\n", s, m1, m2);
 			return false;
 		}
 	}
 	return true;
 }
 
-int hit::build_splice_positions()
+int hit::build_splice_positions(const options &opt)
 {
 	spos.clear();
 	int32_t p = pos;
@@ -161,8 +141,8 @@ int hit::build_splice_positions()
 		if(bam_cigar_op(cigar[k]) != BAM_CREF_SKIP) continue;
 		if(bam_cigar_op(cigar[k-1]) != BAM_CMATCH) continue;
 		if(bam_cigar_op(cigar[k+1]) != BAM_CMATCH) continue;
-		if(bam_cigar_oplen(cigar[k-1]) < min_flank_length) continue;
-		if(bam_cigar_oplen(cigar[k+1]) < min_flank_length) continue;
+		if(bam_cigar_oplen(cigar[k-1]) < opt.min_flank_length) continue;
+		if(bam_cigar_oplen(cigar[k+1]) < opt.min_flank_length) continue;
 
 		int32_t s = p - bam_cigar_oplen(cigar[k]);
 		spos.push_back(pack(s, p));
@@ -255,3 +235,70 @@ inline bool hit_compare_right(const hit &x, const hit &y)
 	return false;
 }
 */
+
+int64_t aux_integer(const uint8_t *p, int64_t missing)
+{
+	if(p == NULL) return missing;
+	if(strchr("cCsSiI", *p) == NULL || *p == '\0') return missing;
+	return bam_aux2i(p);
+}
+
+int32_t edit_distance(const bam1_t *b)
+{
+	int64_t x = aux_integer(bam_aux_get(b, "NM"), -1);
+	if(x < 0) x = aux_integer(bam_aux_get(b, "nM"), -1);
+	return (int32_t)x;
+}
+
+int copy_sequence(bam1_t *b, const bam1_t *d)
+{
+	// complement of a 4-bit base: the bits of A, C, G, T reversed
+	static const uint8_t comp[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+
+	int l = d->core.l_qseq;
+	bool rc = ((b->core.flag ^ d->core.flag) & 0x10) != 0;
+	int head = bam_get_seq(b) - b->data;
+	int aux = bam_get_l_aux(b);
+	int m = head + (l + 1) / 2 + l + aux;
+
+	vector<uint8_t> v(m, 0);
+	memcpy(v.data(), b->data, head);
+	uint8_t *s = v.data() + head;
+	uint8_t *q = s + (l + 1) / 2;
+	const uint8_t *ds = bam_get_seq(d);
+	const uint8_t *dq = bam_get_qual(d);
+	for(int i = 0; i < l; i++)
+	{
+		int j = rc ? l - 1 - i : i;
+		uint8_t c = bam_seqi(ds, j);
+		if(rc) c = comp[c];
+		s[i >> 1] |= c << ((~i & 1) << 2);
+		q[i] = (dq[0] == 0xff) ? 0xff : dq[j];
+	}
+	memcpy(q + l, bam_get_aux(b), aux);
+
+	if(m > b->m_data)
+	{
+		uint8_t *x = (uint8_t*)realloc(b->data, m);
+		if(x == NULL) printf("fail to allocate %d bytes for %s\n", m, bam_get_qname(b));
+		if(x == NULL) exit(0);
+		b->data = x;
+		b->m_data = m;
+	}
+	memcpy(b->data, v.data(), m);
+	b->l_data = m;
+	b->core.l_qseq = l;
+	return 0;
+}
+
+string cigar_string(const uint32_t *cigar, int n)
+{
+	string s;
+	char buf[16];
+	for(int i = 0; i < n; i++)
+	{
+		snprintf(buf, sizeof(buf), "%u%c", bam_cigar_oplen(cigar[i]), bam_cigar_opchr(cigar[i]));
+		s.append(buf);
+	}
+	return s;
+}
@@ -36,12 +36,27 @@ typedef struct {
 } bam1_core_t;
 */
 
+/*
+ library type as a compile-time tag: strand[] maps bits 0x8-0x80 of the
+ flag, i.e., (flag >> 3) & 0x1F, to the inferred transcript strand
+*/
+template<int L>
+class library
+{
+public:
+	static const char strand[32];
+};
+
+template<> const char library<UNSTRANDED>::strand[32];
+template<> const char library<FR_FIRST>::strand[32];
+template<> const char library<FR_SECOND>::strand[32];
+
 class hit: public bam1_core_t
 {
 public:
 	hit(int32_t p);
-	hit(const hit &h);
 	hit(bam1_t *b, int depth);
+	template<int L> hit(bam1_t *b, int depth, library<L>);
 	bool operator<(const hit &h) const;
 
 public:
@@ -59,12 +74,25 @@ public:
 
 public:
 	int print() const;
-	bool verify_junctions();
-	int build_splice_positions();
+	bool verify_junctions(const options &opt) const;
+	int build_splice_positions(const options &opt);
 	int get_mid_intervals(vector<int64_t> &vm, vector<int64_t> &vi, vector<int64_t> &vd) const;
 	int get_matched_intervals(vector<int64_t> &v) const;
 };
 
 //inline bool hit_compare_by_name(const hit &x, const hit &y);
 
+// cigar in the text form of SAM
+string cigar_string(const uint32_t *cigar, int n);
+
+// value of an integer aux field of any width (cCsSiI), or missing
+int64_t aux_integer(const uint8_t *p, int64_t missing);
+
+// NM, or nM when NM is absent, or -1
+int32_t edit_distance(const bam1_t *b);
+
+// give b the SEQ and QUAL of d, another record of the same read and segment,
+// reversed and complemented when their strands differ
+int copy_sequence(bam1_t *b, const bam1_t *d);
+
 #endif
@@ -0,0 +1,142 @@
+#include <algorithm>
+
+#include "interval.h"
+
+bool interval_index::item::operator<(const item &x) const
+{
+	if(seq != x.seq) return seq < x.seq;
+	if(start != x.start) return start < x.start;
+	return end < x.end;
+}
+
+interval_index::interval_index()
+{
+}
+
+int interval_index::add(int32_t seq, int32_t start, int32_t end, int32_t value)
+{
+	if(seq < 0 || end <= start) return 0;
+	item x;
+	x.seq = seq;
+	x.start = start;
+	x.end = end;
+	x.max = end;
+	x.value = value;
+	items.push_back(x);
+	return 0;
+}
+
+size_t interval_index::size() const
+{
+	return items.size();
+}
+
+int interval_index::build()
+{
+	sort(items.begin(), items.end());
+
+	int32_t n = items.size() == 0 ? 0 : items.back().seq + 1;
+	offset.assign(n + 1, items.size());
+	levels.assign(n, -1);
+	for(int64_t i = items.size() - 1; i >= 0; i--) offset[items[i].seq] = i;
+	for(int32_t s = n - 1; s >= 0; s--)
+	{
+		if(offset[s] > offset[s + 1]) offset[s] = offset[s + 1];
+	}
+
+	for(int32_t s = 0; s < n; s++)
+	{
+		levels[s] = index(items.data() + offset[s], offset[s + 1] - offset[s]);
+	}
+	return 0;
+}
+
+// max fields of the implicit tree over a[0, n), returns the level of its root
+int interval_index::index(item *a, int64_t n)
+{
+	if(n <= 0) return -1;
+
+	int64_t last_i = 0;
+	int32_t last = 0;
+	for(int64_t i = 0; i < n; i += 2)
+	{
+		last_i = i;
+		last = a[i].max = a[i].end;
+	}
+
+	int k = 1;
+	for(; ((int64_t)1 << k) <= n; k++)
+	{
+		int64_t x = 1LL << (k - 1);
+		int64_t i0 = (x << 1) - 1;
+		int64_t step = x << 2;
+		for(int64_t i = i0; i < n; i += step)
+		{
+			int32_t el = a[i - x].max;
+			int32_t er = (i + x < n) ? a[i + x].max : last;
+			a[i].max = max(a[i].end, max(el, er));
+		}
+		last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+		if(last_i < n && a[last_i].max > last) last = a[last_i].max;
+	}
+	return k - 1;
+}
+
+int interval_index::overlap(int32_t seq, int32_t start, int32_t end, vector<int32_t> &values) const
+{
+	if(seq < 0 || seq >= levels.size() || levels[seq] < 0) return 0;
+
+	const item *a = items.data() + offset[seq];
+	int64_t n = offset[seq + 1] - offset[seq];
+
+	// (node, level, whether its left subtree is done)
+	int64_t stack[64][3];
+	int t = 0;
+	stack[t][0] = ((int64_t)1 << levels[seq]) - 1;
+	stack[t][1] = levels[seq];
+	stack[t][2] = 0;
+	t++;
+
+	while(t > 0)
+	{
+		t--;
+		int64_t x = stack[t][0];
+		int k = stack[t][1];
+		int w = stack[t][2];
+
+		// small subtrees are scanned
+		if(k <= 3)
+		{
+			int64_t i0 = x >> k << k;
+			int64_t i1 = min(i0 + ((int64_t)1 << (k + 1)) - 1, n);
+			for(int64_t i = i0; i < i1 && a[i].start < end; i++)
+			{
+				if(start < a[i].end) values.push_back(a[i].value);
+			}
+		}
+		else if(w == 0)
+		{
+			int64_t y = x - ((int64_t)1 << (k - 1));
+			stack[t][0] = x;
+			stack[t][1] = k;
+			stack[t][2] = 1;
+			t++;
+			if(y >= n || a[y].max > start)
+			{
+				stack[t][0] = y;
+				stack[t][1] = k - 1;
+				stack[t][2] = 0;
+				t++;
+			}
+		}
+		else if(x < n && a[x].start < end)
+		{
+			if(start < a[x].end) values.push_back(a[x].value);
+			stack[t][0] = x + ((int64_t)1 << (k - 1));
+			stack[t][1] = k - 1;
+			stack[t][2] = 0;
+			t++;
+		}
+	}
+	return 0;
+}
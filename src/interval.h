@@ -0,0 +1,46 @@
+#ifndef __INTERVAL_H__
+#define __INTERVAL_H__
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ intervals [start, end) with a value on numbered sequences, in one flat
+ array sorted by (sequence, start); every sequence is an implicit
+ interval tree: the array is a complete binary search tree laid out in
+ order, each node keeping the maximal end of its subtree
+*/
+class interval_index
+{
+public:
+	interval_index();
+
+public:
+	int add(int32_t seq, int32_t start, int32_t end, int32_t value);
+	int build();
+	int overlap(int32_t seq, int32_t start, int32_t end, vector<int32_t> &values) const;	// appends values
+	size_t size() const;
+
+private:
+	class item
+	{
+	public:
+		int32_t seq;
+		int32_t start;
+		int32_t end;
+		int32_t max;					// maximal end in the subtree
+		int32_t value;
+		bool operator<(const item &x) const;
+	};
+
+	vector<item> items;
+	vector<int64_t> offset;				// items of sequence s are [offset[s], offset[s + 1])
+	vector<int> levels;					// level of the root of each sequence
+
+private:
+	int index(item *a, int64_t n);
+};
+
+#endif
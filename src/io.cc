@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+
+#include "io.h"
+
+static bool has_suffix(const string &s, const string &x)
+{
+	if(s.size() < x.size()) return false;
+	return s.compare(s.size() - x.size(), x.size(), x) == 0;
+}
+
+string output_mode(const options &opt, const string &file)
+{
+	string f = opt.output_format;
+	if(f == "auto")
+	{
+		if(has_suffix(file, ".cram")) f = "cram";
+		else if(has_suffix(file, ".sam") || file == "-") f = "sam";
+		else f = "bam";
+	}
+
+	string mode = "w";
+	if(f == "bam") mode += "b";
+	if(f == "cram") mode += "c";
+	if(f != "sam" && opt.compression_level >= 0) mode += char('0' + opt.compression_level);
+	return mode;
+}
+
+string output_extension(const options &opt)
+{
+	if(opt.output_format == "cram") return ".cram";
+	if(opt.output_format == "sam") return ".sam";
+	return ".bam";
+}
+
+int strip_bgzf_eof(const string &file)
+{
+	static const char eof[BGZF_EOF_BYTES + 1] = "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
+
+	FILE *fp = fopen(file.c_str(), "rb");
+	if(fp == NULL) return -1;
+	char buf[BGZF_EOF_BYTES];
+	int f = fseeko(fp, -BGZF_EOF_BYTES, SEEK_END);
+	size_t n = (f == 0) ? fread(buf, 1, BGZF_EOF_BYTES, fp) : 0;
+	off_t size = ftello(fp);
+	fclose(fp);
+	if(n != BGZF_EOF_BYTES || memcmp(buf, eof, BGZF_EOF_BYTES) != 0) return -1;
+
+	f = truncate(file.c_str(), size - BGZF_EOF_BYTES);
+	if(f != 0) printf("fail to truncate %s\n", file.c_str());
+	if(f != 0) exit(0);
+	return 0;
+}
+
+htsThreadPool *shared_pool(const options &opt)
+{
+	static htsThreadPool pool = {NULL, 0};
+	static once_flag flag;
+	call_once(flag, [&opt]()
+	{
+		if(opt.threads >= 2) pool.pool = hts_tpool_init(opt.threads);
+	});
+	return (pool.pool == NULL) ? NULL : &pool;
+}
+
+samFile *open_input(const options &opt, const string &file)
+{
+	samFile *fin = sam_open(file.c_str(), "r");
+	if(fin == NULL) return NULL;
+
+	int format = hts_get_format(fin)->format;
+	if(format == cram && opt.reference != "") hts_set_fai_filename(fin, opt.reference.c_str());
+
+	// uncompressed SAM is read through its hFILE by sam_scanner, so it gets no threads
+	htsThreadPool *p = shared_pool(opt);
+	if(p != NULL && (format == bam || format == cram)) hts_set_thread_pool(fin, p);
+	return fin;
+}
+
+samFile *open_output(const options &opt, const string &file, bool append)
+{
+	string mode = output_mode(opt, file);
+	if(append == true && mode.find('c') != string::npos) printf("CRAM output %s can not be reopened to append\n", file.c_str());
+	if(append == true && mode.find('c') != string::npos) exit(0);
+	if(append == true && mode.find('b') != string::npos) strip_bgzf_eof(file);
+	if(append == true) mode[0] = 'a';
+
+	samFile *fout = sam_open(file.c_str(), mode.c_str());
+	if(fout == NULL) printf("fail to open %s\n", file.c_str());
+	if(fout == NULL) exit(0);
+
+	if(mode.find('c') != string::npos && opt.reference == "") printf("CRAM output %s needs --reference\n", file.c_str());
+	if(mode.find('c') != string::npos && opt.reference == "") exit(0);
+	if(mode.find('c') != string::npos) hts_set_fai_filename(fout, opt.reference.c_str());
+
+	htsThreadPool *p = shared_pool(opt);
+	if(p != NULL && mode.find_first_of("bc") != string::npos) hts_set_thread_pool(fout, p);
+	return fout;
+}
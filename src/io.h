@@ -0,0 +1,32 @@
+#ifndef __IO_H__
+#define __IO_H__
+
+#include "config.h"
+#include <htslib/sam.h>
+#include <htslib/thread_pool.h>
+
+#define BGZF_EOF_BYTES 28			// bytes of the empty block ending a BGZF file
+
+using namespace std;
+
+// htslib mode for writing file: by --output_format, else by its extension
+string output_mode(const options &opt, const string &file);
+
+// extension of files named by bamkit (split): .cram, .sam or .bam
+string output_extension(const options &opt);
+
+// open for reading; CRAM is decoded with --reference, BAM/CRAM with the shared pool
+samFile *open_input(const options &opt, const string &file);
+
+// open for writing in the format of output_mode, exit on failure; with
+// append, a BAM or SAM file written before is continued (its header is kept
+// and the BGZF EOF block removed), CRAM can not be continued
+samFile *open_output(const options &opt, const string &file, bool append = false);
+
+// remove the empty BGZF block that ends a closed BAM file, -1 if there is none
+int strip_bgzf_eof(const string &file);
+
+// one pool of --threads threads for (de)compression of all files
+htsThreadPool *shared_pool(const options &opt);
+
+#endif
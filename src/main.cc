@@ -14,89 +14,199 @@ See LICENSE for licensing.
 
 #include "config.h"
 #include "bamkit.h"
+#include "server.h"
 
 using namespace std;
 
+int print_usage(const char *prog)
+{
+	printf("usage: \n");
+	printf(" %s count <bam-file> [options]\n", prog);
+	printf(" %s strand <bam-file> [options]\n", prog);
+	printf(" %s fragment <bam-file> [options]\n", prog);
+	printf(" %s junction <bam-file> [options]\n", prog);
+	printf(" %s stats <bam-file> [options]\n", prog);
+	printf(" %s pairs <bam-file> [options]\n", prog);
+	printf(" %s dupstat <bam-file> [options]\n", prog);
+	printf(" %s basestats <bam-file> [options]\n", prog);
+	printf(" %s edits <bam-file> [options]\n", prog);
+	printf(" %s genecount <bam-file> <gtf-file> [options]\n", prog);
+	printf(" %s ts2XS <in-bam-file> <out-bam-file>\n", prog);
+	printf(" %s name2to1 <in-bam-file> <out-bam-file>\n", prog);
+	printf(" %s --help for all commands and options\n", prog);
+	return 0;
+}
+
 int main(int argc, const char **argv)
 {
 	srand(time(0));
 
-	if(argc < 3 || argc > 6)
+	options opt;
+	opt.parse_arguments(argc, argv);
+
+	const string &cmd = opt.command;
+	const vector<string> &args = opt.args;
+
+	if(cmd == "serve")
 	{
-		printf("usage: \n");
-		printf(" %s count <bam-file>\n", argv[0]);
-		printf(" %s strand <bam-file>\n", argv[0]);
-		printf(" %s fragment <bam-file>\n", argv[0]);
-		printf(" %s ts2XS <in-bam-file> <out-bam-file>\n", argv[0]);
-		printf(" %s name2to1 <in-bam-file> <out-bam-file>\n", argv[0]);
+		if(opt.socket == "") printf("Error: serve requires --socket <path>\n");
+		if(opt.socket == "") return 0;
+		server sv(opt);
+		sv.run(opt.socket);
 		return 0;
 	}
 
-	if(string(argv[1]) == "count")
+	if(args.size() < 1 || args.size() > 4)
 	{
-		bamkit bk(argv[2]);
+		print_usage(argv[0]);
+		return 0;
+	}
+
+	if(opt.verbose >= 2) print_command_line(argc, argv);
+	if(opt.verbose >= 2) opt.print_parameters();
+
+	if(cmd == "count")
+	{
+		bamkit bk(args[0], opt);
 		bk.solve_count();
 	}
 
-	if(string(argv[1]) == "strand")
+	if(cmd == "strand")
 	{
-		bamkit bk(argv[2]);
+		bamkit bk(args[0], opt);
 		bk.solve_strand();
 	}
 
-	if(string(argv[1]) == "fragment")
+	if(cmd == "fragment")
 	{
-		bamkit bk(argv[2]);
+		bamkit bk(args[0], opt);
 		bk.solve_fragment();
 	}
 
-	if(string(argv[1]) == "ts2XS")
+	if(cmd == "junction")
+	{
+		bamkit bk(args[0], opt);
+		bk.solve_junction();
+	}
+
+	if(cmd == "stats")
+	{
+		bamkit bk(args[0], opt);
+		bk.solve_stats();
+	}
+
+	if(cmd == "pairs")
+	{
+		bamkit bk(args[0], opt);
+		bk.solve_pairs();
+	}
+
+	if(cmd == "dupstat")
+	{
+		bamkit bk(args[0], opt);
+		bk.solve_dupstat();
+	}
+
+	if(cmd == "basestats")
 	{
-		bamkit bk(argv[2]);
-		bk.ts2XS(argv[3]);
+		bamkit bk(args[0], opt);
+		bk.solve_basestats();
 	}
 
-	if(string(argv[1]) == "name2to1")
+	if(cmd == "edits")
 	{
-		bamkit bk(argv[2]);
-		bk.name2to1(argv[3]);
+		bamkit bk(args[0], opt);
+		bk.solve_edits();
 	}
 
-    if(string(argv[1]) == "alignPairEval")
+	if(cmd == "genecount" && args.size() >= 2)
+	{
+		bamkit bk(args[0], opt);
+		bk.solve_genecount(args[1]);
+	}
+
+	if(cmd == "ts2XS" && args.size() >= 2)
+	{
+		bamkit bk(args[0], opt);
+		bk.ts2XS(args[1]);
+	}
+
+	if(cmd == "name2to1" && args.size() >= 2)
+	{
+		bamkit bk(args[0], opt);
+		bk.name2to1(args[1]);
+	}
+
+    if(cmd == "alignPairEval" && args.size() >= 2)
     {
-        bamkit bk(argv[2]);
-        bk.alignPairEval(argv[3]);
+        bamkit bk(args[0], opt);
+        bk.alignPairEval(args[1]);
     }
 
-    if(string(argv[1]) == "bridgeEval")
+    if(cmd == "bridgeEval" && args.size() >= 4)
     {
-        bamkit bk(argv[2]);
-        bk.bridgeEval(argv[3], argv[4], argv[5]);
+        bamkit bk(args[0], opt);
+        bk.bridgeEval(args[1], args[2], args[3]);
 
     }
     
-    if(string(argv[1]) == "addXS")
+    if(cmd == "addXS" && args.size() >= 2)
 	{
-		bamkit bk(argv[2]);
-		bk.addXS(argv[3]);
+		// instantiate the classifier for the library type once here
+		bamkit bk(args[0], opt);
+		if(opt.library_type == UNSTRANDED) bk.addXS<UNSTRANDED>(args[1]);
+		if(opt.library_type == FR_FIRST) bk.addXS<FR_FIRST>(args[1]);
+		if(opt.library_type == FR_SECOND) bk.addXS<FR_SECOND>(args[1]);
 	}
 
-    if(string(argv[1]) == "splitByEnd")
+    if(cmd == "splitByEnd" && args.size() >= 3)
     {
-        bamkit bk(argv[2]);
-        bk.splitByEnd(argv[3], argv[4]);
+		if(opt.library_type == UNSTRANDED)
+		{
+			printf("Error: splitByEnd requires a stranded library type\n");
+			return 0;
+		}
+        bamkit bk(args[0], opt);
+		if(opt.library_type == FR_FIRST) bk.splitByEnd<FR_FIRST>(args[1], args[2]);
+		if(opt.library_type == FR_SECOND) bk.splitByEnd<FR_SECOND>(args[1], args[2]);
     }
     
-    if(string(argv[1]) == "filter2ndAlign")
+    if(cmd == "filter2ndAlign" && args.size() >= 2)
 	{
-		bamkit bk(argv[2]);
-		bk.filter2ndAlign(argv[3]);
+		bamkit bk(args[0], opt);
+		bk.filter2ndAlign(args[1]);
 	}
 	
-    if(string(argv[1]) == "splitSinglePaired")
+    if(cmd == "splitSinglePaired" && args.size() >= 3)
+    {
+        bamkit bk(args[0], opt);
+        bk.splitSinglePaired(args[1], args[2]);
+    }
+
+    if(cmd == "collate" && args.size() >= 2)
+    {
+        bamkit bk(args[0], opt);
+        bk.collate(args[1]);
+    }
+
+    if(cmd == "pick-primary" && args.size() >= 2)
+    {
+        bamkit bk(args[0], opt);
+        bk.pick_primary(args[1]);
+    }
+
+    if(cmd == "filter-junctions" && args.size() >= 2)
+    {
+        bamkit bk(args[0], opt);
+        bk.filter_junctions(args[1]);
+    }
+
+    if(cmd == "split" && args.size() >= 2)
     {
-        bamkit bk(argv[2]);
-        bk.splitSinglePaired(argv[3], argv[4]);
+        bamkit bk(args[0], opt);
+		if(opt.library_type == UNSTRANDED) bk.split<UNSTRANDED>(opt.split_by, args[1]);
+		if(opt.library_type == FR_FIRST) bk.split<FR_FIRST>(opt.split_by, args[1]);
+		if(opt.library_type == FR_SECOND) bk.split<FR_SECOND>(opt.split_by, args[1]);
     }
     return 0;
 }
@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "mate.h"
+
+mate_collector::mate_collector(const options &o)
+	: collector(o)
+{
+	pairs = 0;
+	concordant = 0;
+	overlapping = 0;
+	orphans = 0;
+	distant = 0;
+	skipped = 0;
+	peak = 0;
+	fvec.assign(1000, 0);
+}
+
+int mate_collector::add(bam1_t *b)
+{
+	bam1_core_t &p = b->core;
+
+	if((p.flag & 0x1) <= 0) return 0;				// not paired
+	if((p.flag & 0x4) >= 1) return 0;				// read is not mapped
+	if((p.flag & 0x8) >= 1) return 0;				// mate is not mapped
+	if((p.flag & 0x900) >= 1) return 0;				// secondary or supplementary alignment
+
+	evict(p.tid, p.pos);
+
+	if(p.mtid != p.tid)
+	{
+		distant++;
+		return 0;
+	}
+	if(p.n_cigar > MAX_NUM_CIGAR || p.n_cigar < 1)
+	{
+		skipped++;
+		return 0;
+	}
+
+	hit ht(b, 5);
+	vector<int64_t> v;
+	ht.get_matched_intervals(v);
+
+	unordered_map<string, mate>::iterator it = waiting.find(ht.qname);
+	if(it != waiting.end())
+	{
+		resolve(it->second, ht, v);
+		waiting.erase(it);
+		return 0;
+	}
+
+	// the mate is to the left but has not been seen
+	if(p.mpos < p.pos) return 0;
+
+	mate &m = waiting[ht.qname];
+	m.pos = ht.pos;
+	m.rpos = ht.rpos;
+	m.reverse = ((p.flag & 0x10) >= 1);
+	m.intervals.swap(v);
+	expiry.push(PIS(pack(p.tid, p.mpos), ht.qname));
+	if(waiting.size() > peak) peak = waiting.size();
+	return 0;
+}
+
+int mate_collector::evict(int32_t tid, int32_t pos)
+{
+	int64_t x = pack(tid, pos);
+	while(expiry.size() >= 1 && expiry.top().first < x)
+	{
+		if(waiting.erase(expiry.top().second) >= 1) orphans++;
+		expiry.pop();
+	}
+	return 0;
+}
+
+int mate_collector::resolve(const mate &x, const hit &y, const vector<int64_t> &vy)
+{
+	pairs++;
+
+	bool yrev = ((y.flag & 0x10) >= 1);
+	if(x.reverse != yrev && x.reverse == false) concordant++;
+	if(y.pos < x.rpos) overlapping++;
+
+	// union of matched intervals, both lists are sorted
+	vector<int64_t> v(x.intervals.size() + vy.size());
+	std::merge(x.intervals.begin(), x.intervals.end(), vy.begin(), vy.end(), v.begin());
+
+	int64_t len = 0;
+	int32_t s = -1, t = -1;
+	for(int i = 0; i < v.size(); i++)
+	{
+		int32_t a = high32(v[i]);
+		int32_t b = low32(v[i]);
+		if(a > t)
+		{
+			len += t - s;
+			s = a;
+			t = b;
+		}
+		else if(b > t) t = b;
+	}
+	len += t - s;
+
+	// the part between the mates is not sequenced and taken as is
+	if(y.pos > x.rpos) len += y.pos - x.rpos;
+
+	if(len > 0 && len < fvec.size()) fvec[len]++;
+	return 0;
+}
+
+int mate_collector::fragment_length(double &fave, double &fdev) const
+{
+	int64_t fcnt = 0;
+	fave = 0;
+	fdev = 0;
+	for(int i = 1; i < fvec.size(); i++)
+	{
+		fcnt += fvec[i];
+		fave += fvec[i] * i;
+	}
+	if(fcnt <= 0) return 0;
+	fave = fave / fcnt;
+
+	for(int i = 1; i < fvec.size(); i++)
+	{
+		fdev += (i - fave) * (i - fave) * fvec[i];
+	}
+	fdev = sqrt(fdev / fcnt);
+	return 0;
+}
+
+int mate_collector::print() const
+{
+	double fave, fdev;
+	fragment_length(fave, fdev);
+	printf("matched pairs = %ld concordant = %ld overlapping = %ld orphans = %ld distant = %ld fragment length = %.2lf +- %.2lf\n",
+			pairs, concordant, overlapping, orphans + (int64_t)(waiting.size()), distant, fave, fdev);
+	if(opt.verbose >= 2) printf("maximum waiting mates = %lu, skipped = %ld\n", peak, skipped);
+	return 0;
+}
+
+string mate_collector::json() const
+{
+	double fave, fdev;
+	fragment_length(fave, fdev);
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"matched_pairs\":%ld,\"concordant\":%ld,\"overlapping\":%ld,\"orphans\":%ld,\"distant\":%ld,\"fragment_length\":%.2lf,\"fragment_length_dev\":%.2lf}",
+			pairs, concordant, overlapping, orphans + (int64_t)(waiting.size()), distant, fave, fdev);
+	return string(buf);
+}
+
+bool coordinate_sorted(const bam_hdr_t *hdr)
+{
+	if(hdr == NULL || hdr->text == NULL) return false;
+	if(strncmp(hdr->text, "@HD", 3) != 0) return false;
+	const char *e = strchr(hdr->text, '\n');
+	const char *s = strstr(hdr->text, "\tSO:coordinate");
+	return (s != NULL && (e == NULL || s < e));
+}
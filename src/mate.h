@@ -0,0 +1,60 @@
+#ifndef __MATE_H__
+#define __MATE_H__
+
+#include "collector.h"
+#include <queue>
+#include <unordered_map>
+
+using namespace std;
+
+// first mate waiting for the second one
+class mate
+{
+public:
+	int32_t pos;
+	int32_t rpos;
+	bool reverse;
+	vector<int64_t> intervals;			// matched intervals
+};
+
+/*
+ pairs mates in coordinate-sorted input: the leftmost mate waits in a hash
+ keyed by query name and is evicted once the scan passes its mpos, so memory
+ is bounded by the reads within one insert-size window; the fragment length
+ is the length of the union of the matched intervals of both mates plus the
+ unsequenced gap between them, i.e., splice gaps are not counted
+*/
+class mate_collector: public collector
+{
+public:
+	mate_collector(const options &opt);
+
+public:
+	int64_t pairs;						// mates matched
+	int64_t concordant;					// on opposite strands, forward mate leftmost
+	int64_t overlapping;				// mates overlapping on the genome
+	int64_t orphans;					// mate never seen at its mpos
+	int64_t distant;					// mate on another chromosome
+	int64_t skipped;					// too many cigar operations
+	vector<int64_t> fvec;				// histogram of fragment lengths
+	size_t peak;						// maximum number of waiting mates
+
+public:
+	int add(bam1_t *b);
+	int print() const;
+	string json() const;
+	int fragment_length(double &ave, double &dev) const;
+
+private:
+	unordered_map<string, mate> waiting;
+	typedef pair<int64_t, string> PIS;
+	priority_queue< PIS, vector<PIS>, greater<PIS> > expiry;	// (pack(tid, mpos), qname)
+
+private:
+	int evict(int32_t tid, int32_t pos);
+	int resolve(const mate &x, const hit &y, const vector<int64_t> &v);
+};
+
+bool coordinate_sorted(const bam_hdr_t *hdr);
+
+#endif
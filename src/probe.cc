@@ -0,0 +1,67 @@
+#include <cstdio>
+
+#include "probe.h"
+#include "util.h"
+
+const char *skip_names[SKIP_REASONS] = {"unmapped", "mate_unmapped", "secondary", "supplementary", "cigar", "low_mapq", "spliced", "no_xs", "no_gene"};
+
+filter_probe::filter_probe()
+{
+	for(int i = 0; i < SKIP_REASONS; i++) skips[i] = 0;
+	timed = 0;
+	seconds = 0;
+}
+
+int filter_probe::merge(const filter_probe &p)
+{
+	for(int i = 0; i < SKIP_REASONS; i++) skips[i] += p.skips[i];
+	timed += p.timed;
+	seconds += p.seconds;
+	return 0;
+}
+
+// the reasons that skipped anything, and the sampled time per record
+int filter_probe::print() const
+{
+#ifndef BAMKIT_NO_PROBES
+	printf("skipped");
+	for(int i = 0; i < SKIP_REASONS; i++)
+	{
+		if(skips[i] >= 1) printf(" %s = %ld", skip_names[i], skips[i]);
+	}
+	if(timed >= 1) printf(" time per record = %.1lf ns (%ld sampled)", seconds * 1e9 / timed, timed);
+	printf("\n");
+#endif
+	return 0;
+}
+
+string filter_probe::json() const
+{
+	string s = "{";
+	for(int i = 0; i < SKIP_REASONS; i++)
+	{
+		if(i >= 1) s += ",";
+		s += "\"" + string(skip_names[i]) + "\":" + tostring(skips[i]);
+	}
+	if(timed >= 1) s += ",\"ns_per_record\":" + tostring((int64_t)(seconds * 1e9 / timed));
+	s += "}";
+	return s;
+}
+
+int filter_probe::save(ostream &os) const
+{
+	for(int i = 0; i < SKIP_REASONS; i++)
+	{
+		os << skips[i] << (i + 1 == SKIP_REASONS ? "\n" : " ");
+	}
+	return os.good() ? 0 : -1;
+}
+
+int filter_probe::load(istream &is)
+{
+	for(int i = 0; i < SKIP_REASONS; i++)
+	{
+		if(!(is >> skips[i])) return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include <string>
+#include <iostream>
+#include <stdint.h>
+
+using namespace std;
+
+// reasons for a collector to skip a record
+#define SKIP_UNMAPPED 0
+#define SKIP_MATE_UNMAPPED 1
+#define SKIP_SECONDARY 2
+#define SKIP_SUPPLEMENTARY 3
+#define SKIP_CIGAR 4					// more than MAX_NUM_CIGAR operations, or none
+#define SKIP_MAPQ 5
+#define SKIP_SPLICED 6					// fragment only takes unspliced reads
+#define SKIP_NO_XS 7
+#define SKIP_NO_GENE 8					// no gene, or genes on both strands
+#define SKIP_REASONS 9
+
+#define PROBE_PERIOD 1024				// one record in so many is timed
+
+#ifdef BAMKIT_NO_PROBES
+#define PROBES_ENABLED false
+#else
+#define PROBES_ENABLED true
+#endif
+
+extern const char *skip_names[SKIP_REASONS];
+
+/*
+ records skipped by a collector, by reason, and the time its add()
+ took on a sample of records; every collector (so every scanning
+ thread) has its own, merged with the collectors. Building with
+ -DBAMKIT_NO_PROBES removes the counting and the timing entirely
+*/
+class filter_probe
+{
+public:
+	filter_probe();
+
+public:
+	int64_t skips[SKIP_REASONS];		// records skipped by reason
+	int64_t timed;						// records timed
+	double seconds;						// spent in add() of the timed records
+
+public:
+#ifdef BAMKIT_NO_PROBES
+	inline int skip(int reason) { return 0; }
+	inline int skip(int reason, int64_t n) { return 0; }
+	inline int time(double s) { return 0; }
+#else
+	inline int skip(int reason) { skips[reason]++; return 0; }
+	inline int skip(int reason, int64_t n) { skips[reason] += n; return 0; }
+	inline int time(double s) { timed++; seconds += s; return 0; }
+#endif
+	int merge(const filter_probe &p);
+	int print() const;
+	string json() const;
+	int save(ostream &os) const;
+	int load(istream &is);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <sys/stat.h>
+#include <htslib/bgzf.h>
+#include <htslib/hfile.h>
+
+#include "progress.h"
+#include "engine.h"
+
+progress_meter::progress_meter(const string &file, bool j)
+	: json(j), records(0), bytes(0)
+{
+	struct stat st;
+	total = 0;
+	if(file != "" && file != "-" && stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) total = st.st_size;
+
+	start = current_time();
+	last = 0;
+	closing = false;
+	timer = thread(&progress_meter::run, this);
+}
+
+progress_meter::~progress_meter()
+{
+	close();
+}
+
+int progress_meter::advance(int64_t r, int64_t b)
+{
+	records += r;
+	if(b > 0) bytes += b;
+	return 0;
+}
+
+int progress_meter::update(samFile *sfn, int64_t r)
+{
+	int64_t p = input_offset(sfn);
+	advance(r, p >= last ? p - last : 0);
+	if(p >= 0) last = p;
+	return 0;
+}
+
+int progress_meter::close()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		if(closing == true) return 0;
+		closing = true;
+	}
+	cv.notify_all();
+	timer.join();
+	print(true);
+	return 0;
+}
+
+int progress_meter::run()
+{
+	unique_lock<mutex> lock(mtx);
+	while(closing == false)
+	{
+		cv.wait_for(lock, chrono::seconds(PROGRESS_SECONDS));
+		if(closing == true) break;
+		print(false);
+	}
+	return 0;
+}
+
+int progress_meter::print(bool final) const
+{
+	double t = current_time() - start;
+	int64_t r = records;
+	int64_t b = bytes;
+	if(final == true && total > 0) b = total;
+
+	double rps = (t > 0) ? r / t : 0;
+	double mbps = (t > 0) ? b / t / 1048576.0 : 0;
+	double fraction = (total > 0) ? min(1.0, 1.0 * b / total) : -1;
+	double eta = (total > 0 && b > 0) ? t * (total - b) / b : -1;
+	if(final == true) eta = 0;
+
+	if(json == true)
+	{
+		fprintf(stderr, "{\"progress\":%.4lf,\"records\":%ld,\"bytes\":%ld,\"seconds\":%.1lf,\"records_per_second\":%.0lf,\"mb_per_second\":%.2lf,\"eta_seconds\":%.0lf,\"done\":%s}\n",
+				fraction, r, b, t, rps, mbps, eta, final ? "true" : "false");
+	}
+	else
+	{
+		fprintf(stderr, "progress:");
+		if(fraction >= 0) fprintf(stderr, " %.1lf%%", fraction * 100);
+		fprintf(stderr, " records = %ld (%.0lf/s) %.2lf MB/s", r, rps, mbps);
+		if(eta >= 0 && final == false) fprintf(stderr, " ETA %ld:%02ld:%02ld", (int64_t)eta / 3600, (int64_t)eta / 60 % 60, (int64_t)eta % 60);
+		if(final == true) fprintf(stderr, " done in %.1lf s", t);
+		fprintf(stderr, "\n");
+	}
+	fflush(stderr);
+	return 0;
+}
+
+int64_t input_offset(samFile *sfn)
+{
+	if(sfn->is_cram == 1) return -1;
+	if(sfn->is_bgzf == 1) return bgzf_tell(sfn->fp.bgzf) >> 16;
+	return htell(sfn->fp.hfile);
+}
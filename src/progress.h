@@ -0,0 +1,53 @@
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+#include <htslib/sam.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+#define PROGRESS_SECONDS 10				// between two progress lines
+#define PROGRESS_PERIOD 1024			// records between two updates by a reader
+
+/*
+ progress of a scan on stderr: readers add the records and compressed
+ bytes they consumed every PROGRESS_PERIOD records, and a timer thread
+ prints the rate, the fraction of the file and the time left every
+ PROGRESS_SECONDS seconds, as text or as JSON lines
+*/
+class progress_meter
+{
+public:
+	progress_meter(const string &file, bool json);
+	~progress_meter();
+
+public:
+	int advance(int64_t records, int64_t bytes);	// from any thread
+	int update(samFile *sfn, int64_t records);		// by the only reader of sfn: records since the last update
+	int close();									// stop the timer and print the final line
+
+private:
+	int64_t total;						// compressed size of the file, 0 if unknown
+	bool json;
+	double start;
+	atomic<int64_t> records;
+	atomic<int64_t> bytes;
+	int64_t last;						// offset of sfn at the last update
+	mutex mtx;
+	condition_variable cv;
+	bool closing;
+	thread timer;
+
+private:
+	int run();
+	int print(bool final) const;
+};
+
+// compressed offset reached in sfn, -1 if unknown (CRAM)
+int64_t input_offset(samFile *sfn);
+
+#endif
@@ -0,0 +1,335 @@
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+#define MAX_NUM_HANDLES 64
+#define MAX_NUM_RESULTS 4096
+
+handle::handle()
+{
+	mtime = -1;
+	size = -1;
+	sfn = NULL;
+	hdr = NULL;
+	idx = NULL;
+	offset = -1;
+}
+
+handle::~handle()
+{
+	if(idx != NULL) hts_idx_destroy(idx);
+	if(hdr != NULL) bam_hdr_destroy(hdr);
+	if(sfn != NULL) sam_close(sfn);
+}
+
+int handle::open(const string &file, int64_t t, int64_t s)
+{
+	path = file;
+	mtime = t;
+	size = s;
+
+	sfn = sam_open(file.c_str(), "r");
+	if(sfn == NULL) return -1;
+	hdr = sam_hdr_read(sfn);
+	if(hdr == NULL) return -1;
+
+	// only bgzf-compressed bam can be rewound cheaply
+	if(hts_get_format(sfn)->format == bam) offset = bgzf_tell(sfn->fp.bgzf);
+
+	struct stat st;
+	string bai = file + ".bai";
+	string csi = file + ".csi";
+	if(offset >= 0 && (stat(bai.c_str(), &st) == 0 || stat(csi.c_str(), &st) == 0))
+	{
+		idx = sam_index_load(sfn, file.c_str());
+	}
+	return 0;
+}
+
+int handle::rewind()
+{
+	if(offset < 0) return -1;
+	if(bgzf_seek(sfn->fp.bgzf, offset, SEEK_SET) < 0) return -1;
+	return 0;
+}
+
+server::server(const options &o)
+	: opt(o)
+{
+	sock = -1;
+	stop = false;
+}
+
+server::~server()
+{
+	for(list<handle*>::iterator it = handles.begin(); it != handles.end(); it++)
+	{
+		delete *it;
+	}
+	if(sock >= 0) close(sock);
+}
+
+int server::run(const string &file)
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(file.size() >= sizeof(addr.sun_path))
+	{
+		printf("socket path %s is too long\n", file.c_str());
+		return -1;
+	}
+	strcpy(addr.sun_path, file.c_str());
+
+	unlink(file.c_str());
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sock < 0 || bind(sock, (struct sockaddr*)(&addr), sizeof(addr)) < 0 || listen(sock, 128) < 0)
+	{
+		printf("fail to listen on %s\n", file.c_str());
+		return -1;
+	}
+
+	if(opt.verbose >= 1) printf("serving on %s with %d threads\n", file.c_str(), opt.threads);
+	fflush(stdout);
+
+	vector<thread> workers;
+	for(int i = 0; i < opt.threads; i++)
+	{
+		workers.push_back(thread(&server::work, this));
+	}
+
+	while(true)
+	{
+		int fd = accept(sock, NULL, NULL);
+
+		unique_lock<mutex> lock(cmtx);
+		if(fd < 0 && stop == true) break;
+		if(fd < 0) continue;
+		clients.push_back(fd);
+		ccv.notify_one();
+	}
+
+	for(int i = 0; i < workers.size(); i++) workers[i].join();
+	unlink(file.c_str());
+	return 0;
+}
+
+int server::work()
+{
+	while(true)
+	{
+		int fd = -1;
+		{
+			unique_lock<mutex> lock(cmtx);
+			while(stop == false && clients.size() == 0) ccv.wait(lock);
+			if(clients.size() == 0) break;
+			fd = clients.front();
+			clients.pop_front();
+		}
+		serve(fd);
+		close(fd);
+	}
+	return 0;
+}
+
+int server::serve(int fd)
+{
+	// one request per line, until the client closes
+	string buf;
+	char data[4096];
+	while(true)
+	{
+		ssize_t n = read(fd, data, sizeof(data));
+		if(n <= 0) break;
+		buf.append(data, n);
+
+		size_t k;
+		while((k = buf.find('\n')) != string::npos)
+		{
+			string response = query(buf.substr(0, k)) + "\n";
+			buf.erase(0, k + 1);
+			if(write(fd, response.c_str(), response.size()) < 0) return -1;
+		}
+	}
+	return 0;
+}
+
+string server::query(const string &request)
+{
+	string command = json_string(request, "command");
+	string path = json_string(request, "path");
+
+	if(command == "shutdown")
+	{
+		unique_lock<mutex> lock(cmtx);
+		stop = true;
+		ccv.notify_all();
+		shutdown(sock, SHUT_RDWR);
+		return "{\"status\":\"ok\"}";
+	}
+
+	if(command != "count" && command != "fragment" && command != "strand" && command != "junction" && command != "idxstats")
+	{
+		return "{\"status\":\"error\",\"message\":\"unknown command\"}";
+	}
+
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0)
+	{
+		return "{\"status\":\"error\",\"message\":\"cannot access " + json_escape(path) + "\"}";
+	}
+
+	int64_t mtime = st.st_mtime;
+	int64_t size = st.st_size;
+	string key = path + "\t" + tostring(mtime) + "\t" + tostring(size) + "\t" + command;
+
+	string result;
+	if(lookup(key, result) == true) return "{\"status\":\"ok\",\"cached\":true,\"result\":" + result + "}";
+
+	handle *h = checkout(path, mtime, size);
+	if(h == NULL) return "{\"status\":\"error\",\"message\":\"cannot open " + json_escape(path) + "\"}";
+
+	result = solve(h, command);
+	checkin(h);
+
+	if(result == "") return "{\"status\":\"error\",\"message\":\"" + json_escape(command) + " is not available for " + json_escape(path) + "\"}";
+
+	remember(key, result);
+	return "{\"status\":\"ok\",\"cached\":false,\"result\":" + result + "}";
+}
+
+string server::solve(handle *h, const string &command)
+{
+	if(command == "idxstats")
+	{
+		if(h->idx == NULL) return "";
+		uint64_t mapped = 0, unmapped = 0;
+		for(int i = 0; i < h->hdr->n_targets; i++)
+		{
+			uint64_t m = 0, u = 0;
+			hts_idx_get_stat(h->idx, i, &m, &u);
+			mapped += m;
+			unmapped += u;
+		}
+		unmapped += hts_idx_get_n_no_coor(h->idx);
+		return "{\"mapped\":" + tostring(mapped) + ",\"unmapped\":" + tostring(unmapped) + "}";
+	}
+
+	collector *c = NULL;
+	if(command == "count") c = new count_collector(opt, false);
+	if(command == "fragment") c = new count_collector(opt, true);
+	if(command == "strand") c = new strand_collector(opt, 100000);
+	if(command == "junction") c = new junction_collector(opt, h->hdr);
+
+	engine eg;
+	eg.push(c);
+	eg.run(h->sfn, h->hdr);
+	string result = c->json();
+	delete c;
+	return result;
+}
+
+handle* server::checkout(const string &path, int64_t mtime, int64_t size)
+{
+	{
+		unique_lock<mutex> lock(hmtx);
+		for(list<handle*>::iterator it = handles.begin(); it != handles.end(); it++)
+		{
+			handle *h = *it;
+			if(h->path != path) continue;
+			handles.erase(it);
+			if(h->mtime == mtime && h->size == size && h->rewind() == 0) return h;
+			delete h;
+			break;
+		}
+	}
+
+	handle *h = new handle();
+	if(h->open(path, mtime, size) == 0) return h;
+	delete h;
+	return NULL;
+}
+
+int server::checkin(handle *h)
+{
+	if(h->offset < 0)
+	{
+		delete h;
+		return 0;
+	}
+
+	unique_lock<mutex> lock(hmtx);
+	handles.push_front(h);
+	while(handles.size() > MAX_NUM_HANDLES)
+	{
+		delete handles.back();
+		handles.pop_back();
+	}
+	return 0;
+}
+
+bool server::lookup(const string &key, string &result)
+{
+	unique_lock<mutex> lock(rmtx);
+	map<string, LR::iterator>::iterator it = rindex.find(key);
+	if(it == rindex.end()) return false;
+	results.splice(results.begin(), results, it->second);
+	result = it->second->second;
+	return true;
+}
+
+int server::remember(const string &key, const string &result)
+{
+	unique_lock<mutex> lock(rmtx);
+	if(rindex.find(key) != rindex.end()) return 0;
+	results.push_front(make_pair(key, result));
+	rindex[key] = results.begin();
+	while(results.size() > MAX_NUM_RESULTS)
+	{
+		rindex.erase(results.back().first);
+		results.pop_back();
+	}
+	return 0;
+}
+
+string json_string(const string &json, const string &key)
+{
+	// value of a string field in a flat JSON object, no escapes
+	size_t k = json.find("\"" + key + "\"");
+	if(k == string::npos) return "";
+	k = json.find(':', k + key.size() + 2);
+	if(k == string::npos) return "";
+	k = json.find('"', k + 1);
+	if(k == string::npos) return "";
+	size_t e = json.find('"', k + 1);
+	if(e == string::npos) return "";
+	return json.substr(k + 1, e - k - 1);
+}
+
+// s as the contents of a JSON string
+string json_escape(const string &s)
+{
+	string r;
+	for(int i = 0; i < s.size(); i++)
+	{
+		unsigned char c = s[i];
+		if(c == '"' || c == '\\') r += '\\';
+		if(c >= 0x20)
+		{
+			r += c;
+			continue;
+		}
+		char buf[8];
+		snprintf(buf, sizeof(buf), "\\u%04x", c);
+		r += buf;
+	}
+	return r;
+}
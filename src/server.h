@@ -0,0 +1,79 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "engine.h"
+#include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+// an opened bam file that can be rewound to its first record
+class handle
+{
+public:
+	handle();
+	~handle();
+
+public:
+	string path;
+	int64_t mtime;
+	int64_t size;
+	samFile *sfn;
+	bam_hdr_t *hdr;
+	hts_idx_t *idx;						// NULL if there is no index
+	int64_t offset;						// virtual offset of the first record
+
+public:
+	int open(const string &file, int64_t mtime, int64_t size);
+	int rewind();
+};
+
+/*
+ answers one-line JSON requests, e.g.,
+ {"command": "count", "path": "/data/x.bam"}, over a unix socket;
+ opened files and results are kept in LRU caches
+*/
+class server
+{
+public:
+	server(const options &opt);
+	~server();
+
+public:
+	int run(const string &socket);
+
+private:
+	options opt;
+	int sock;
+	bool stop;
+
+	deque<int> clients;							// accepted connections
+	mutex cmtx;
+	condition_variable ccv;
+
+	list<handle*> handles;						// idle handles, most recent first
+	mutex hmtx;
+
+	typedef list< pair<string, string> > LR;	// (key, result), most recent first
+	LR results;
+	map<string, LR::iterator> rindex;
+	mutex rmtx;
+
+private:
+	int work();
+	int serve(int fd);
+	string query(const string &request);
+	string solve(handle *h, const string &command);
+	handle* checkout(const string &path, int64_t mtime, int64_t size);
+	int checkin(handle *h);
+	bool lookup(const string &key, string &result);
+	int remember(const string &key, const string &result);
+};
+
+string json_string(const string &json, const string &key);
+string json_escape(const string &s);
+
+#endif
@@ -0,0 +1,243 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <sys/stat.h>
+#include <htslib/bgzf.h>
+
+#include "shard.h"
+
+bgzf_shards::bgzf_shards(const string &f, const bam_hdr_t *h)
+	: file(f), hdr(h)
+{
+	struct stat st;
+	size = (stat(file.c_str(), &st) == 0) ? st.st_size : -1;
+}
+
+bool bgzf_shards::applicable(samFile *sfn, const string &file)
+{
+	if(file == "" || file == "-") return false;
+	if(hts_get_format(sfn)->format != bam) return false;
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0) return false;
+	return S_ISREG(st.st_mode);
+}
+
+bool bgzf_header(const uint8_t *p, int64_t n, int &bsize)
+{
+	if(n < 18) return false;
+	if(p[0] != 31 || p[1] != 139 || p[2] != 8 || (p[3] & 4) == 0) return false;
+	if(p[10] != 6 || p[11] != 0) return false;				// XLEN
+	if(p[12] != 'B' || p[13] != 'C' || p[14] != 2 || p[15] != 0) return false;
+	bsize = (p[16] | (p[17] << 8)) + 1;
+	return bsize >= 28;
+}
+
+static int32_t le32(const uint8_t *p)
+{
+	return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+bool bam_record_header(const uint8_t *p, int64_t n, const bam_hdr_t *hdr, int64_t &length)
+{
+	if(n < 36) return false;
+	int32_t block_size = le32(p);
+	int32_t tid = le32(p + 4);
+	int32_t pos = le32(p + 8);
+	int l_qname = p[12];
+	int n_cigar = le16(p + 16);
+	int32_t l_seq = le32(p + 20);
+	int32_t mtid = le32(p + 24);
+	int32_t mpos = le32(p + 28);
+
+	if(tid < -1 || tid >= hdr->n_targets) return false;
+	if(mtid < -1 || mtid >= hdr->n_targets) return false;
+	if(pos < -1 || mpos < -1) return false;
+	if(l_qname < 2 || l_seq < 0) return false;
+	if((int64_t)32 + l_qname + 4 * n_cigar + (l_seq + 1) / 2 + l_seq > block_size) return false;
+
+	// the query name is printable and NUL-terminated
+	if(n < 36 + l_qname) return false;
+	for(int i = 0; i < l_qname - 1; i++)
+	{
+		if(p[36 + i] < '!' || p[36 + i] > '~') return false;
+	}
+	if(p[36 + l_qname - 1] != '\0') return false;
+
+	length = 4 + (int64_t)block_size;
+	return true;
+}
+
+int64_t bgzf_shards::block_at(int64_t offset) const
+{
+	FILE *fp = fopen(file.c_str(), "rb");
+	if(fp == NULL) return -1;
+
+	vector<uint8_t> buf(SHARD_SCAN_SIZE + 18);
+	if(fseeko(fp, offset, SEEK_SET) != 0)
+	{
+		fclose(fp);
+		return -1;
+	}
+	int64_t n = fread(buf.data(), 1, buf.size(), fp);
+	fclose(fp);
+
+	// a candidate counts if the next header follows it, or it ends the file
+	for(int64_t i = 0; i + 18 <= n; i++)
+	{
+		int bsize, next;
+		if(bgzf_header(buf.data() + i, n - i, bsize) == false) continue;
+		if(offset + i + bsize == size) return offset + i;
+		if(i + bsize + 18 <= n && bgzf_header(buf.data() + i + bsize, n - i - bsize, next) == true) return offset + i;
+	}
+	return -1;
+}
+
+int64_t bgzf_shards::first_record(BGZF *fp, int64_t block) const
+{
+	if(bgzf_seek(fp, block << 16, SEEK_SET) < 0) return -1;
+
+	// decompressed blocks in a row, with their addresses and starts in data
+	string data;
+	vector<int64_t> address, begin;
+	for(int k = 0; k < SHARD_SCAN_BLOCKS; k++)
+	{
+		if(bgzf_read_block(fp) != 0) break;
+		if(fp->block_length <= 0) break;
+		address.push_back(fp->block_address);
+		begin.push_back(data.size());
+		data.append((const char*)fp->uncompressed_block, fp->block_length);
+	}
+	begin.push_back(data.size());
+
+	const uint8_t *p = (const uint8_t*)data.data();
+	int64_t n = data.size();
+	for(int k = 0; k + 1 < begin.size(); k++)
+	{
+		for(int64_t o = begin[k]; o < begin[k + 1]; o++)
+		{
+			int64_t x = o, length;
+			int c = 0;
+			while(c < SHARD_CHAIN && x < n && bam_record_header(p + x, n - x, hdr, length) == true)
+			{
+				x += length;
+				c++;
+			}
+			if(c < SHARD_CHAIN && x != n) continue;
+			if(c == 0) continue;
+			return (address[k] << 16) | (o - begin[k]);
+		}
+	}
+	return -1;
+}
+
+int bgzf_shards::build(int64_t first, int n)
+{
+	starts.clear();
+	starts.push_back(first);
+	if(size <= 0 || n <= 1) return 0;
+
+	BGZF *fp = bgzf_open(file.c_str(), "r");
+	if(fp == NULL) return 0;
+
+	int64_t b0 = first >> 16;
+	for(int k = 1; k < n; k++)
+	{
+		int64_t offset = b0 + (size - b0) * k / n;
+		int64_t block = block_at(offset);
+		if(block < 0) continue;
+		int64_t v = first_record(fp, block);
+		if(v <= starts.back()) continue;
+		starts.push_back(v);
+	}
+	bgzf_close(fp);
+	return 0;
+}
+
+/*
+ the compressed bytes from the first record are cut into n strata;
+ a shard takes the records starting in the blocks of about span bytes
+ from a random offset of each stratum, so that ends and bytes are exact
+ block addresses and counts per byte can be extrapolated to the file
+*/
+int bgzf_shards::sample(int64_t first, int n, int64_t span, uint64_t seed)
+{
+	starts.clear();
+	ends.clear();
+	bytes.clear();
+	if(size <= 0 || n <= 0) return 0;
+
+	BGZF *fp = bgzf_open(file.c_str(), "r");
+	if(fp == NULL) return 0;
+
+	int64_t b0 = first >> 16;
+	for(int k = 0; k < n; k++)
+	{
+		int64_t s = b0 + (size - b0) * k / n;
+		int64_t t = b0 + (size - b0) * (k + 1) / n;
+		int64_t offset = (t - s > span) ? s + hash64(&k, sizeof(k), seed) % (t - s - span) : s;
+
+		int64_t block = (k == 0 && offset == b0) ? b0 : block_at(offset);
+		if(block < 0) continue;
+		if(ends.size() >= 1 && block < ends.back()) continue;
+		int64_t end = (block + span < size) ? block_at(block + span) : size;
+		if(end < 0) end = size;
+
+		int64_t v = (block == b0) ? first : first_record(fp, block);
+		if(v < 0) continue;
+		starts.push_back(v);
+		ends.push_back(end);
+		bytes.push_back(end - block);
+	}
+	bgzf_close(fp);
+	return 0;
+}
+
+int bgzf_shards::run(int threads, const function<bool(int, int, bam1_t*)> &f, progress_meter *meter) const
+{
+	// a failing worker stops all of them, the caller reports it
+	atomic<int> next(0);
+	atomic<bool> failed(false);
+	vector<thread> workers;
+	for(int w = 0; w < threads; w++)
+	{
+		workers.push_back(thread([this, w, &next, &failed, &f, meter]()
+		{
+			BGZF *fp = bgzf_open(file.c_str(), "r");
+			if(fp == NULL) failed = true;
+			if(fp == NULL) return;
+			bam1_t *b = bam_init1();
+			bool more = true;
+			for(int k = next++; more == true && failed == false && k < starts.size(); k = next++)
+			{
+				int64_t end = (k + 1 < starts.size()) ? starts[k + 1] : -1;
+				int s = bgzf_seek(fp, starts[k], SEEK_SET);
+				if(s < 0) failed = true;
+				if(s < 0) break;
+				int64_t n = 0, last = starts[k] >> 16;
+				while(k < ends.size() ? (bgzf_tell(fp) >> 16) < ends[k] : (end < 0 || bgzf_tell(fp) < end))
+				{
+					int r = bam_read1(fp, b);
+					if(r < -1) failed = true;
+					if(r < 0 || failed == true) break;
+					if(f(w, k, b) == false) more = false;
+					if(more == false) break;
+					if(meter == NULL || ++n % PROGRESS_PERIOD != 0) continue;
+					meter->advance(PROGRESS_PERIOD, (bgzf_tell(fp) >> 16) - last);
+					last = bgzf_tell(fp) >> 16;
+				}
+				if(meter != NULL) meter->advance(n % PROGRESS_PERIOD, (bgzf_tell(fp) >> 16) - last);
+			}
+			bam_destroy1(b);
+			bgzf_close(fp);
+		}));
+	}
+	for(int w = 0; w < workers.size(); w++) workers[w].join();
+	return (failed == true) ? -1 : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include "hit.h"
+#include "progress.h"
+#include <functional>
+
+using namespace std;
+
+#define SHARD_SCAN_SIZE (1 << 18)			// compressed bytes searched for a block header
+#define SHARD_SCAN_BLOCKS 16				// decompressed blocks searched for a record start
+#define SHARD_CHAIN 4						// consecutive records validated at a candidate start
+
+/*
+ byte-range shards of an unindexed BAM: BGZF block boundaries are found
+ by their header magic and the first record of a block by validating a
+ chain of record headers; shard k holds the records with virtual
+ offsets in [starts[k], starts[k + 1]), the last one runs to the end
+*/
+class bgzf_shards
+{
+public:
+	bgzf_shards(const string &file, const bam_hdr_t *hdr);
+
+public:
+	string file;
+	const bam_hdr_t *hdr;
+	int64_t size;							// compressed size of the file
+	vector<int64_t> starts;					// virtual offsets of the first records
+	vector<int64_t> ends;					// sampled shards only: block address ending each
+	vector<int64_t> bytes;					// sampled shards only: compressed bytes of each
+
+public:
+	int build(int64_t first, int n);		// n shards of the records from virtual offset first
+	int sample(int64_t first, int n, int64_t span, uint64_t seed);	// up to n shards of span bytes, one at a random offset of each nth
+	int64_t block_at(int64_t offset) const;	// first block starting at or after offset, -1 if none
+	int64_t first_record(BGZF *fp, int64_t block) const;	// first record from block on, -1 if none
+	int run(int threads, const function<bool(int, int, bam1_t*)> &f, progress_meter *meter = NULL) const;	// f(worker, shard, record), false to stop the worker; -1 if the file can not be read
+
+public:
+	static bool applicable(samFile *sfn, const string &file);
+};
+
+// whether p (n bytes) holds the fixed part of a BGZF block header
+bool bgzf_header(const uint8_t *p, int64_t n, int &bsize);
+
+// whether p (n bytes available) starts a plausible BAM record, sets its length
+bool bam_record_header(const uint8_t *p, int64_t n, const bam_hdr_t *hdr, int64_t &length);
+
+#endif
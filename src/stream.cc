@@ -0,0 +1,126 @@
+#include <cstring>
+#include <cstdlib>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "stream.h"
+
+#define SCANNER_BUFFER_SIZE (4 << 20)
+
+sam_scanner::sam_scanner(samFile *f, bam_hdr_t *h, bool s)
+	: sfn(f), hdr(h), skip_unmapped(s)
+{
+	buf.resize(SCANNER_BUFFER_SIZE);
+	begin = end = 0;
+	eof = false;
+	dropped = 0;
+
+	// sam_hdr_read has already taken the first record
+	if(sfn->line.l > 0)
+	{
+		if(sfn->line.l + 1 > buf.size()) buf.resize(sfn->line.l + 1);
+		memcpy(buf.data(), sfn->line.s, sfn->line.l);
+		end = sfn->line.l;
+		buf[end++] = '\n';
+		sfn->line.l = 0;
+	}
+}
+
+bool sam_scanner::applicable(samFile *sfn)
+{
+	const htsFormat *fmt = hts_get_format(sfn);
+	return (fmt->format == sam && fmt->compression == no_compression);
+}
+
+int sam_scanner::fill()
+{
+	if(begin > 0)
+	{
+		memmove(buf.data(), buf.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+	}
+	if(end == buf.size()) buf.resize(buf.size() * 2);
+
+	ssize_t n = hread(sfn->fp.hfile, buf.data() + end, buf.size() - end);
+	if(n < 0) return -1;
+	if(n == 0) eof = true;
+	end += n;
+	return 0;
+}
+
+int sam_scanner::next(bam1_t *b)
+{
+	// returns before reading more input when lines were dropped, so the
+	// caller sees them (and its clock) at least once per buffer
+	int64_t d = dropped;
+	while(true)
+	{
+		char *s = buf.data() + begin;
+		char *nl = (char*)(memchr(s, '\n', end - begin));
+
+		if(nl == NULL && eof == true && begin == end) return -1;
+		if(nl == NULL && eof == true)
+		{
+			// last line without a newline
+			if(end == buf.size()) buf.resize(buf.size() + 1);
+			buf[end++] = '\n';
+			continue;
+		}
+		if(nl == NULL && dropped > d) return 1;
+		if(nl == NULL)
+		{
+			if(fill() < 0) return -2;
+			continue;
+		}
+
+		int l = nl - s;
+		begin += l + 1;
+		if(l > 0 && s[l - 1] == '\r') l--;
+		if(l == 0) continue;
+		s[l] = '\0';
+
+		if(skip_unmapped == true)
+		{
+			int tabs[2];
+			if(find_tabs(s, l, tabs, 2) == 2 && (atoi(s + tabs[0] + 1) & 0x4) >= 1)
+			{
+				dropped++;
+				continue;
+			}
+		}
+
+		kstring_t ks;
+		ks.l = l;
+		ks.m = l + 1;
+		ks.s = s;
+		if(sam_parse1(&ks, hdr, b) < 0) return -2;
+		return 0;
+	}
+	return -1;
+}
+
+int find_tabs(const char *s, int n, int *tabs, int k)
+{
+	int m = 0;
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i t = _mm_set1_epi8('\t');
+	for(; i + 16 <= n && m < k; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, t));
+		while(mask != 0 && m < k)
+		{
+			tabs[m++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for(; i < n && m < k; i++)
+	{
+		if(s[i] == '\t') tabs[m++] = i;
+	}
+	return m;
+}
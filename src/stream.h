@@ -0,0 +1,41 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "hit.h"
+#include "htslib/hfile.h"
+
+using namespace std;
+
+/*
+ reads records from an uncompressed SAM stream (e.g., a pipe from an aligner)
+ without copying lines; tabs are located 16 bytes at a time so that records
+ rejected by their flag are dropped before they are parsed
+*/
+class sam_scanner
+{
+public:
+	sam_scanner(samFile *sfn, bam_hdr_t *hdr, bool skip_unmapped);
+
+public:
+	int next(bam1_t *b);		// 0 with a record, 1 without one (lines were dropped before a refill), -1 at the end, < -1 on error
+	static bool applicable(samFile *sfn);
+
+public:
+	int64_t dropped;			// unmapped records skipped without parsing
+
+private:
+	samFile *sfn;
+	bam_hdr_t *hdr;
+	bool skip_unmapped;
+	vector<char> buf;
+	size_t begin;
+	size_t end;
+	bool eof;
+
+private:
+	int fill();
+};
+
+int find_tabs(const char *s, int n, int *tabs, int k);
+
+#endif
@@ -13,3 +13,21 @@ vector<int> get_random_permutation(int n)
 	}
 	return v;
 }
+
+uint64_t hash64(const void *data, size_t n, uint64_t seed)
+{
+	// FNV-1a followed by a murmur3 finalizer
+	const unsigned char *p = (const unsigned char *)(data);
+	uint64_t h = 14695981039346656037ULL ^ seed;
+	for(size_t i = 0; i < n; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
@@ -163,5 +163,6 @@ vector<K> get_keys(const map<K, V> &m)
 }
 
 vector<int> get_random_permutation(int n);
+uint64_t hash64(const void *data, size_t n, uint64_t seed = 0);
 
 #endif
@@ -0,0 +1,219 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+
+#include "writer.h"
+#include "util.h"
+
+async_writer::async_writer(const string &name, const char *mode, const bam_hdr_t *h)
+	: file(name), hdr(h)
+{
+	records = 0;
+	closing = false;
+	closed = false;
+
+	fout = sam_open(file.c_str(), mode);
+	if(fout == NULL) printf("fail to open %s\n", file.c_str());
+	if(fout == NULL) exit(0);
+	start(true);
+}
+
+async_writer::async_writer(const options &opt, const string &name, const bam_hdr_t *h, bool append)
+	: file(name), hdr(h)
+{
+	records = 0;
+	closing = false;
+	closed = false;
+	fout = open_output(opt, file, append);
+	start(append == false);
+}
+
+int async_writer::start(bool header)
+{
+	int f = (header == true) ? sam_hdr_write(fout, hdr) : 0;
+	if(f < 0) printf("fail to write header to %s\n", file.c_str());
+	if(f < 0) exit(0);
+
+	worker = thread(&async_writer::run, this);
+	return 0;
+}
+
+async_writer::~async_writer()
+{
+	close();
+	for(int i = 0; i < pool.size(); i++)
+	{
+		for(int k = 0; k < pool[i].size(); k++) bam_destroy1(pool[i][k]);
+	}
+	for(int k = 0; k < batch.size(); k++) bam_destroy1(batch[k]);
+}
+
+int async_writer::write(const bam1_t *b)
+{
+	if(batch.size() <= records % WRITER_BATCH_SIZE) batch.push_back(bam_init1());
+	bam_copy1(batch[records % WRITER_BATCH_SIZE], b);
+	records++;
+	if(records % WRITER_BATCH_SIZE == 0) flush();
+	return 0;
+}
+
+int async_writer::flush()
+{
+	int n = (records % WRITER_BATCH_SIZE == 0) ? WRITER_BATCH_SIZE : records % WRITER_BATCH_SIZE;
+	if(records == 0 || batch.size() == 0) return 0;
+
+	unique_lock<mutex> lock(mtx);
+	while(queue.size() >= WRITER_QUEUE_SIZE) cv.wait(lock);
+
+	// records beyond n in a reused batch are stale
+	for(int k = n; k < batch.size(); k++) bam_destroy1(batch[k]);
+	batch.resize(n);
+
+	queue.push_back(vector<bam1_t*>());
+	queue.back().swap(batch);
+	if(pool.size() >= 1)
+	{
+		batch.swap(pool.back());
+		pool.pop_back();
+	}
+	cv.notify_all();
+	return 0;
+}
+
+int async_writer::run()
+{
+	while(true)
+	{
+		vector<bam1_t*> v;
+		{
+			unique_lock<mutex> lock(mtx);
+			while(queue.size() == 0 && closing == false) cv.wait(lock);
+			if(queue.size() == 0) break;
+			v.swap(queue.front());
+			queue.pop_front();
+		}
+
+		for(int k = 0; k < v.size(); k++)
+		{
+			int f = sam_write1(fout, hdr, v[k]);
+			if(f < 0) printf("fail write alignment to %s\n", file.c_str());
+			if(f < 0) exit(0);
+		}
+
+		unique_lock<mutex> lock(mtx);
+		pool.push_back(vector<bam1_t*>());
+		pool.back().swap(v);
+		cv.notify_all();
+	}
+	return 0;
+}
+
+int async_writer::close()
+{
+	if(closed == true) return 0;
+	if(records % WRITER_BATCH_SIZE != 0) flush();
+	{
+		unique_lock<mutex> lock(mtx);
+		closing = true;
+		cv.notify_all();
+	}
+	worker.join();
+	sam_close(fout);
+	closed = true;
+	return 0;
+}
+
+report_writer::report_writer(const string &name, bool compress, double r)
+	: file(name), rate(r)
+{
+	lines = 0;
+	closing = false;
+	closed = false;
+	fout = NULL;
+	bout = NULL;
+
+	if(compress == true) bout = bgzf_open(file.c_str(), "w");
+	else fout = fopen(file.c_str(), "w");
+	if(fout == NULL && bout == NULL) ::printf("fail to open %s\n", file.c_str());
+	if(fout == NULL && bout == NULL) exit(0);
+
+	buffer.reserve(REPORT_BUFFER_SIZE);
+	worker = thread(&report_writer::run, this);
+}
+
+report_writer::~report_writer()
+{
+	close();
+}
+
+bool report_writer::sample(const string &key) const
+{
+	if(rate >= 1.0) return true;
+	if(rate <= 0.0) return false;
+	return hash64(key.data(), key.size()) < (uint64_t)(rate * 18446744073709551615.0);
+}
+
+int report_writer::printf(const char *fmt, ...)
+{
+	char buf[4096];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if(n < 0) return 0;
+
+	buffer.append(buf, min(n, (int)sizeof(buf) - 1));
+	lines++;
+	if(buffer.size() >= REPORT_BUFFER_SIZE) flush();
+	return 0;
+}
+
+int report_writer::flush()
+{
+	if(buffer.size() == 0) return 0;
+
+	unique_lock<mutex> lock(mtx);
+	while(queue.size() >= WRITER_QUEUE_SIZE) cv.wait(lock);
+	queue.push_back(string());
+	queue.back().swap(buffer);
+	buffer.reserve(REPORT_BUFFER_SIZE);
+	cv.notify_all();
+	return 0;
+}
+
+int report_writer::run()
+{
+	while(true)
+	{
+		string s;
+		{
+			unique_lock<mutex> lock(mtx);
+			while(queue.size() == 0 && closing == false) cv.wait(lock);
+			if(queue.size() == 0) break;
+			s.swap(queue.front());
+			queue.pop_front();
+			cv.notify_all();
+		}
+
+		size_t f = (bout != NULL) ? bgzf_write(bout, s.data(), s.size()) : fwrite(s.data(), 1, s.size(), fout);
+		if(f != s.size()) ::printf("fail to write to %s\n", file.c_str());
+		if(f != s.size()) exit(0);
+	}
+	return 0;
+}
+
+int report_writer::close()
+{
+	if(closed == true) return 0;
+	flush();
+	{
+		unique_lock<mutex> lock(mtx);
+		closing = true;
+		cv.notify_all();
+	}
+	worker.join();
+	if(bout != NULL) bgzf_close(bout);
+	if(fout != NULL) fclose(fout);
+	closed = true;
+	return 0;
+}
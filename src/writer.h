@@ -0,0 +1,92 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include "hit.h"
+#include "io.h"
+#include <htslib/bgzf.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+#define WRITER_BATCH_SIZE 4096
+#define WRITER_QUEUE_SIZE 4
+#define REPORT_BUFFER_SIZE (1 << 20)
+
+/*
+ an output file with its own thread; records are copied into
+ batches and at most WRITER_QUEUE_SIZE batches wait for the thread
+*/
+class async_writer
+{
+public:
+	async_writer(const string &file, const char *mode, const bam_hdr_t *hdr);
+	async_writer(const options &opt, const string &file, const bam_hdr_t *hdr, bool append = false);	// in the format of output_mode
+	~async_writer();
+
+public:
+	string file;
+	int64_t records;					// records written
+
+public:
+	int write(const bam1_t *b);
+	int close();						// flush, join the thread and close the file
+
+private:
+	samFile *fout;
+	const bam_hdr_t *hdr;
+	vector<bam1_t*> batch;				// being filled
+	deque< vector<bam1_t*> > queue;		// waiting for the thread
+	vector< vector<bam1_t*> > pool;		// written, to be reused
+	mutex mtx;
+	condition_variable cv;
+	bool closing;
+	bool closed;
+	thread worker;
+
+private:
+	int start(bool header);
+	int flush();
+	int run();
+};
+
+/*
+ a text report written by its own thread in buffers of REPORT_BUFFER_SIZE
+ bytes, optionally BGZF-compressed; sample() keeps a fixed fraction of
+ keys, chosen by hash so that all reports keep the same reads
+*/
+class report_writer
+{
+public:
+	report_writer(const string &file, bool compress, double rate);
+	~report_writer();
+
+public:
+	string file;
+	double rate;						// fraction of keys kept
+	int64_t lines;						// lines written
+
+public:
+	bool sample(const string &key) const;
+	int printf(const char *fmt, ...);
+	int close();
+
+private:
+	FILE *fout;
+	BGZF *bout;
+	string buffer;						// being filled
+	deque<string> queue;				// waiting for the thread
+	mutex mtx;
+	condition_variable cv;
+	bool closing;
+	bool closed;
+	thread worker;
+
+private:
+	int flush();
+	int run();
+};
+
+#endif